@@ -0,0 +1,98 @@
+/**
+ *  This program runs a worker per cpu that walks its own working set
+ * over and over, next to processes that wake up and spin for a while
+ * to push the workers around. It reports the ticks the workers take,
+ * first free to move between cpus and then each pinned to its own cpu
+ * with sched_setaffinity(). Pinned workers keep their working sets in
+ * the cache of their cpu.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define WSET        0x10000   // (bytes) working set of a worker
+#define NPASS       2000      // walks over the working set
+#define NNOISE      2         // processes pushing workers around
+#define NOISETICKS  2000      // (ticks) lifetime of a noise process
+
+void
+worker(void)
+{
+  char *buf;
+  int i, j, sum;
+
+  if ((buf = malloc(WSET)) == 0) {
+    printf(1, "affinitybench: out of memory\n");
+    exit();
+  }
+  memset(buf, 1, WSET);
+  sum = 0;
+  for (i = 0; i < NPASS; ++i)
+    for (j = 0; j < WSET; j += 16)
+      sum += buf[j]++;
+  // Keep the walk from being optimized away.
+  if (sum == 0)
+    printf(1, "\n");
+}
+
+void
+noise(void)
+{
+  int start, tick;
+
+  start = uptime();
+  while (uptime() - start < NOISETICKS) {
+    sleep(1);
+    tick = uptime();
+    while (uptime() == tick)
+      ;
+  }
+}
+
+// Run workers, pinned to cpus or not, and return the ticks taken.
+int
+run(int ncpu, int pin)
+{
+  int i, start, noisepid[NNOISE];
+
+  for (i = 0; i < NNOISE; ++i) {
+    if ((noisepid[i] = fork()) == 0) {
+      noise();
+      exit();
+    }
+  }
+
+  start = uptime();
+  for (i = 0; i < ncpu; ++i) {
+    if (fork() == 0) {
+      if (pin && sched_setaffinity(0, 1 << i) < 0) {
+        printf(1, "affinitybench: cannot pin to cpu %d\n", i);
+        exit();
+      }
+      worker();
+      exit();
+    }
+  }
+  for (i = 0; i < ncpu; ++i)
+    wait();
+  start = uptime() - start;
+
+  for (i = 0; i < NNOISE; ++i)
+    kill(noisepid[i]);
+  for (i = 0; i < NNOISE; ++i)
+    wait();
+  return start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ncpu;
+
+  ncpu = argc >= 2 ? atoi(argv[1]) : 2;
+  printf(1, "%d workers\n", ncpu);
+  printf(1, "free: %d ticks\n", run(ncpu, 0));
+  printf(1, "pinned: %d ticks\n", run(ncpu, 1));
+  exit();
+}
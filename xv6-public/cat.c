@@ -9,6 +9,13 @@ cat(int fd)
 {
   int n;
 
+  // Move data inside the kernel when both ends allow it.
+  while((n = splice(fd, 1, 4096)) > 0)
+    ;
+  if(n == 0)
+    return;
+
+  // Fall back to copying through a user buffer.
   while((n = read(fd, buf, sizeof(buf))) > 0) {
     if (write(1, buf, n) != n) {
       printf(1, "cat: write error\n");
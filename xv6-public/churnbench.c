@@ -0,0 +1,75 @@
+/**
+ *  This program creates and joins short-lived threads in rounds,
+ * with stacks of a few different sizes, and reports free memory and
+ * process size after each round. Both should stay flat once the
+ * stacks of the first round are cached.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "thread.h"
+
+#define NTHREAD     8       // threads alive at once
+#define NROUND      10      // default number of rounds
+#define NBATCH      50      // create/join batches per round
+#define NSIZE       3       // distinct stack sizes
+
+uint stacksizes[NSIZE] = { 4096, 16384, 65536 };
+
+void*
+worker(void *arg)
+{
+  volatile char buf[1024];
+
+  // Touch the stack.
+  buf[0] = (int)arg;
+  buf[sizeof(buf) - 1] = buf[0];
+  thread_exit((void*)(int)buf[sizeof(buf) - 1]);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int round, batch, i, start, first;
+  int nround = NROUND;
+  void *retval;
+  thread_t tid[NTHREAD];
+  struct thread_attr attr;
+
+  if (argc >= 2)
+    nround = atoi(argv[1]);
+
+  memset(&attr, 0, sizeof(attr));
+  attr.guardsize = 4096;
+  first = 0;
+  for (round = 0; round < nround; ++round) {
+    start = uptime();
+    for (batch = 0; batch < NBATCH; ++batch) {
+      for (i = 0; i < NTHREAD; ++i) {
+        attr.stacksize = stacksizes[(batch + i) % NSIZE];
+        if (thread_create_attr(&tid[i], &attr, worker, (void*)i) != 0) {
+          printf(1, "churnbench: thread_create_attr failed\n");
+          exit();
+        }
+      }
+      for (i = 0; i < NTHREAD; ++i) {
+        if (thread_join(tid[i], &retval) != 0 || (int)retval != i) {
+          printf(1, "churnbench: thread_join failed\n");
+          exit();
+        }
+      }
+    }
+    if (round == 0)
+      first = freemem();
+    printf(1, "round %d: %d threads in %d ticks, %d free pages, sz %d\n",
+           round, NBATCH * NTHREAD, uptime() - start, freemem(),
+           (int)sbrk(0));
+  }
+  if (nround > 1 && freemem() < first) {
+    printf(1, "churnbench: leaked %d pages\n", first - freemem());
+    exit();
+  }
+  exit();
+}
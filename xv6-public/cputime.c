@@ -0,0 +1,77 @@
+/**
+ *  This program checks cpu time accounting with the time-stamp counter.
+ * First it spins and compares its cpu time from getrusage() with
+ * the ticks passed. Then a child runs most of every tick but yields
+ * right before the tick ends, the pattern of yieldtests, which used
+ * to be charged nothing. It should still leave the top MLFQ level.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "rusage.h"
+
+#define SPINTICKS   50      // (ticks) length of the spin test
+#define GAMETICKS   200     // (ticks) length of the yield test
+
+// Cpu time of this process in ticks.
+uint
+cputicks(void)
+{
+  struct rusage ru;
+
+  if (getrusage(&ru) < 0) {
+    printf(1, "cputime: getrusage failed\n");
+    exit();
+  }
+  return udiv64(ru.cputime, ru.tscpertick);
+}
+
+void
+spintest(void)
+{
+  uint start, used;
+
+  used = cputicks();
+  start = uptime();
+  while (uptime() - start < SPINTICKS)
+    ;
+  used = cputicks() - used;
+  printf(1, "spin: %d ticks passed, %d ticks of cpu\n", SPINTICKS, used);
+}
+
+void
+gametest(void)
+{
+  struct rusage ru;
+  uint start, tick;
+  uint64 begin;
+
+  getrusage(&ru);
+  start = uptime();
+  while ((tick = uptime()) - start < GAMETICKS) {
+    // Wait for the next tick, run most of it, then yield.
+    while (uptime() == tick)
+      ;
+    begin = rdtsc();
+    while (rdtsc() - begin < ru.tscpertick / 10 * 8)
+      ;
+    yield();
+  }
+  printf(1, "yield: level %d after %d ticks of cpu\n", getlev(), cputicks());
+  if (getlev() == 0)
+    printf(1, "cputime: yielding process was not demoted\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  spintest();
+  if (fork() == 0) {
+    gametest();
+    exit();
+  }
+  wait();
+  exit();
+}
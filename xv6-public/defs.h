@@ -1,17 +1,28 @@
 struct buf;
 struct context;
+struct cpu;
 struct file;
+struct iovec;
 struct inode;
 struct pipe;
 struct proc;
+struct range;
+struct rangelock;
+struct thread_attr;
+struct thread;
 struct rtcdate;
+struct rusage;
 struct spinlock;
 struct sleeplock;
+struct slab;
 struct stat;
 struct superblock;
+struct timepage;
+struct traceevent;
 
 struct stride;
 struct mlfq;
+struct mlfqparam;
 
 // bio.c
 void            binit(void);
@@ -38,6 +49,12 @@ int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 int             filepread(struct file*, char*, int, int);
 int             filepwrite(struct file*, char*, int, int);
+int             filesplice(struct file*, struct file*, int);
+int             filefcntl(struct file*, int, int);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepreadv(struct file*, struct iovec*, int, int);
+int             filepwritev(struct file*, struct iovec*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -71,8 +88,11 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kdup(char*);
+int             krefs(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             kfreepages(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -83,7 +103,9 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
+void            lapictimer(int);
 void            microdelay(int);
 
 // log.c
@@ -92,6 +114,14 @@ void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
 
+// mmap.c
+void            mmapinit(void);
+int             mmap(uint, int, int, int, struct file*, int);
+int             munmap(uint, int);
+int             mmapfault(struct proc*, uint, int);
+int             mmapdup(struct proc*, struct proc*);
+void            mmapclear(struct proc*);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -105,16 +135,22 @@ int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipesize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
 
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
+int             cpuallowed(struct thread*, struct cpu*);
+void            cpukick(struct thread*);
+void            tlbshootdown(struct proc*);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+struct thread*  mythread(void);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
@@ -128,13 +164,33 @@ void            wakeup(void*);
 void            yield(void);
 int             getlev(void);
 int             set_cpu_share(int);
-int             thread_create(int*, void*(*)(void*), void*);
+int             sched_deadline(int, int);
+int             sched_setaffinity(int, uint);
+struct thread*  runqfirst(struct proc*, struct cpu*);
+int             set_thread_share(int, int);
+void            getrusage(struct rusage*);
+void            sleeplockboost(int);
+void            getmlfqparam(struct mlfqparam*);
+int             setmlfqparam(struct mlfqparam*);
+int             thread_create(int*, struct thread_attr*, void*(*)(void*), void*);
 void            thread_exit(void*);
 int             thread_join(int, void**);
+int             thread_yield(int);
+int             killothers(void);
+struct thread*  runqpop(struct proc*, struct thread*);
+struct sleeplock* vmalock(struct proc*);
+int             futex_wait(int*, int);
+int             futex_wake(int*, int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// slab.c
+void            slabinit(struct slab*, char*, uint);
+void*           slaballoc(struct slab*);
+void            slabfree(struct slab*, void*);
+int             slabdrain(struct slab*, int (*)(void*));
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -150,6 +206,11 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// rangelock.c
+void            initrangelock(struct rangelock*, char*);
+struct range*   acquirerange(struct rangelock*, uint, uint, int);
+void            releaserange(struct rangelock*, struct range*);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -160,6 +221,7 @@ int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
 // syscall.c
+int             checkuptr(uint, int);
 int             argint(int, int*);
 int             argptr(int, char**, int);
 int             argstr(int, char**);
@@ -170,9 +232,15 @@ void            syscall(void);
 // timer.c
 void            timerinit(void);
 
+// trace.c
+void            traceinit(void);
+void            trace(int, int, int, int);
+int             traceread(struct traceevent*, int);
+
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+extern uint     tscpertick;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
@@ -181,6 +249,14 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// ustack.c
+void            ustackinit(void);
+uint            ustackalloc(struct proc*, struct thread*, uint, uint);
+void            ustackfree(struct proc*, struct thread*);
+uint            ustackend(struct proc*, uint);
+int             ustackdup(struct proc*, struct proc*, struct thread*, struct thread*);
+void            ustackclear(struct proc*);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
@@ -197,21 +273,36 @@ void            switch_trap_kstack(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             mapuvm(pde_t*, uint, char*, int);
+void            hideuvm(pde_t*, uint);
+char*           unmapuvm(pde_t*, uint, int*);
+int             copyuvmrange(pde_t*, pde_t*, uint, uint);
+int             shareuvmrange(pde_t*, pde_t*, uint, uint);
+extern struct timepage* timepage;
 
 // mlfq.c
 void            stride_init(struct stride*);
 int             stride_append(struct stride*, struct proc*, int);
 void            stride_delete(struct stride*, struct proc*);
-int             stride_update(struct stride*, struct proc*);
-struct proc*    stride_next(struct stride*, int*);
+int             stride_update(struct stride*, struct proc*, uint64);
+struct proc*    stride_next(struct stride*, struct thread**);
+struct proc*    stride_skip(struct stride*, struct thread**);
+void            stride_wake(struct stride*, int);
 
 void            mlfq_init(struct mlfq*);
 int             mlfq_append(struct mlfq*, struct proc*, int);
 int             mlfq_cpu_share(struct mlfq*, struct proc*, int);
+int             mlfq_deadline(struct mlfq*, struct proc*, uint, uint);
+int             mlfq_thread_share(struct mlfq*, struct proc*, struct thread*, int);
+void            mlfq_thread_unshare(struct mlfq*, struct proc*, struct thread*);
 void            mlfq_delete(struct mlfq*, struct proc*);
-int             mlfq_update(struct mlfq*, struct proc*, uint);
-struct proc*    mlfq_next(struct mlfq*, int*);
-void            mlfq_boost(struct mlfq*);
+int             mlfq_update(struct mlfq*, struct proc*, int, uint64);
+struct proc*    mlfq_next(struct mlfq*);
+void            mlfq_boost(struct mlfq*, uint);
+void            mlfq_wake(struct mlfq*, struct proc*, uint64);
+int             mlfq_lend(struct mlfq*, struct proc*, struct proc*);
+void            mlfq_getparam(struct mlfq*, struct mlfqparam*);
+int             mlfq_setparam(struct mlfq*, struct mlfqparam*);
 void            mlfq_scheduler(struct mlfq*, struct spinlock*) __attribute__((noreturn));
 
 void            mlfq_log(struct mlfq*, int);
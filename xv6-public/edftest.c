@@ -0,0 +1,140 @@
+/**
+ *  This program runs deadline processes next to cpu hogs of both the
+ * MLFQ and the stride scheduler. Every period a deadline process
+ * wakes up, uses half of its runtime of cpu and checks that it was
+ * done before the period ended. With the admission control keeping
+ * the deadline processes within MAXEDF, no deadline should be missed,
+ * neither by its own clock nor by the count of getrusage().
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "rusage.h"
+
+#define NHOG        3
+#define NPERIOD     30      // periods run by a deadline process
+#define HOGTICKS    800     // (ticks) lifetime of a hog
+
+struct task {
+  int runtime;              // (ticks)
+  int period;               // (ticks)
+};
+
+struct task tasks[] = {
+  { 2, 10 },
+  { 3, 20 },
+  { 4, 40 },
+};
+
+void
+spin(int ticks)
+{
+  int start = uptime();
+
+  while (uptime() - start < ticks)
+    ;
+}
+
+// Use given cycles of cpu time of this thread.
+void
+work(uint64 cycles)
+{
+  struct rusage ru;
+  uint64 start;
+
+  getrusage(&ru);
+  start = ru.threadtime;
+  do {
+    getrusage(&ru);
+  } while (ru.threadtime - start < cycles);
+}
+
+// Run the periods of task, return the number of deadlines missed.
+int
+runtask(struct task *t)
+{
+  struct rusage ru;
+  int i, start, release, misses;
+
+  if (sched_deadline(t->runtime, t->period) != 0) {
+    printf(1, "edftest: %d/%d not admitted\n", t->runtime, t->period);
+    return NPERIOD;
+  }
+  if (getlev() != -2)
+    printf(1, "edftest: level %d in the deadline class\n", getlev());
+  getrusage(&ru);
+
+  misses = 0;
+  start = uptime();
+  for (i = 0; i < NPERIOD; ++i) {
+    release = start + i * t->period;
+    while (uptime() < release)
+      sleep(1);
+    work((uint64)t->runtime * ru.tscpertick / 2);
+    if (uptime() > release + t->period)
+      misses++;
+  }
+  return misses;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage ru;
+  int i, ntask, misses[2], total, kernel, fd[2];
+
+  for (i = 0; i < NHOG; ++i) {
+    if (fork() == 0) {
+      if (i == 0)
+        set_cpu_share(30);
+      spin(HOGTICKS);
+      exit();
+    }
+  }
+
+  // Admission control turns away more than MAXEDF in total.
+  if (sched_deadline(MAXEDF + 1, 100) != -1)
+    printf(1, "edftest: usage over the limit admitted\n");
+  if (sched_deadline(5, 4) != -1)
+    printf(1, "edftest: runtime over period admitted\n");
+
+  // Tasks report their misses through a pipe.
+  if (pipe(fd) < 0) {
+    printf(1, "edftest: pipe failed\n");
+    exit();
+  }
+  ntask = sizeof(tasks) / sizeof(tasks[0]);
+  for (i = 0; i < ntask; ++i) {
+    if (fork() == 0) {
+      close(fd[0]);
+      misses[0] = runtask(&tasks[i]);
+      getrusage(&ru);
+      misses[1] = ru.misses;
+      printf(1, "task %d/%d: %d of %d deadlines missed, %d by the kernel\n",
+             tasks[i].runtime, tasks[i].period, misses[0], NPERIOD,
+             misses[1]);
+      write(fd[1], misses, sizeof(misses));
+      exit();
+    }
+  }
+  close(fd[1]);
+  total = 0;
+  kernel = 0;
+  while (read(fd[0], misses, sizeof(misses)) == sizeof(misses)) {
+    total += misses[0];
+    kernel += misses[1];
+  }
+  close(fd[0]);
+  for (i = 0; i < NHOG + ntask; ++i)
+    wait();
+
+  if (total != 0)
+    printf(1, "edftest: %d deadlines missed\n", total);
+  else if (kernel != 0)
+    printf(1, "edftest: kernel counted %d deadlines missed\n", kernel);
+  else
+    printf(1, "edftest ok\n");
+  exit();
+}
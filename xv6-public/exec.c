@@ -88,6 +88,10 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
+  // Other threads leave before the old image goes away.
+  if(killothers() < 0)
+    goto bad;
+
   // Save program name for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
@@ -95,31 +99,20 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  mmapclear(curproc);
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
-
-  for (t = curproc->threads; t < &curproc->threads[NTHREAD]; ++t) {
-    off = t - curproc->threads;
-    if (off == curproc->tidx) {
-      // Update eip and esp of current thread.
-      t->tf->eip = elf.entry;
-      t->tf->esp = sp;
-      curproc->ustacks[off] = sz;
-      continue;
-    }
-
-    // Free other threads.
-    if (curproc->kstacks[off] != 0) {
-      kfree(curproc->kstacks[off]);
-      curproc->kstacks[off] = 0;
-      curproc->ustacks[off] = 0;
-    }
-
-    t->kstack = 0;
-    t->state = UNUSED;
-    t->tid = 0;
-  }
+  // No ptable.lock, killothers left us the only thread.
+  ustackclear(curproc);
+
+  // Update eip and esp of current thread.
+  t = mythread();
+  t->tf->eip = elf.entry;
+  t->tf->esp = sp;
+  t->tf->gs = 0;
+  t->tls = 0;
+  t->tlssize = 0;
 
   switchuvm(curproc);
   freevm(oldpgdir);
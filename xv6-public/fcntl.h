@@ -2,3 +2,13 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+#define F_GETPIPE_SZ  1  // get pipe capacity in bytes
+#define F_SETPIPE_SZ  2  // set pipe capacity in bytes
+
+#define PROT_READ     0x1  // mapped pages may be read
+#define PROT_WRITE    0x2  // mapped pages may be written
+
+#define MAP_SHARED    0x1  // writes are carried back to the file
+#define MAP_PRIVATE   0x2  // writes stay in the process
+#define MAP_FAILED    ((void*)-1)
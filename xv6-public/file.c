@@ -5,10 +5,15 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "rangelock.h"
 #include "file.h"
+#include "fcntl.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -92,10 +97,39 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+static uint iovend(struct iovec*, int, uint);
+
+// Lock bytes [off, end) of inode ip in mode, so that read and write
+// exclude positional I/O of the same bytes as well as each other.
+// Only regular files take ranges, others have just the inode lock.
+// Return handle for unlockrange.
+static struct range*
+lockrange(struct inode *ip, uint off, uint end, int mode)
+{
+  if(ip->type != T_FILE)
+    return 0;
+  return acquirerange(&ip->rlock, off, end, mode);
+}
+
+static void
+unlockrange(struct inode *ip, struct range *r)
+{
+  if(r)
+    releaserange(&ip->rlock, r);
+}
+
+// Byte range [off, off + n), clamped at the top.
+static uint
+bufend(uint off, int n)
+{
+  return off + n < off ? 0xFFFFFFFF : off + n;
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
 {
+  struct range *rg;
   int r;
 
   if(f->readable == 0)
@@ -103,10 +137,12 @@ fileread(struct file *f, char *addr, int n)
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
+    rg = lockrange(f->ip, f->off, bufend(f->off, n), RANGE_SHARED);
     ilock(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+    unlockrange(f->ip, rg);
     return r;
   }
   panic("fileread");
@@ -132,6 +168,8 @@ filewrite(struct file *f, char *addr, int n)
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
     int i = 0;
+    // The whole write is one range, though logged in parts.
+    struct range *rg = lockrange(f->ip, f->off, bufend(f->off, n), RANGE_EXCL);
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
@@ -150,69 +188,280 @@ filewrite(struct file *f, char *addr, int n)
         panic("short filewrite");
       i += r;
     }
+    unlockrange(f->ip, rg);
     return i == n ? n : -1;
   }
   panic("filewrite");
 }
 
-// Read from file f.
+// Read from file f without updating offset.
 int
 filepread(struct file *f, char *addr, int n, int offset)
 {
-  int r;
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filepreadv(f, &iov, 1, offset);
+}
+
+// Write to file f without updating offset.
+int
+filepwrite(struct file *f, char *addr, int n, int offset)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filepwritev(f, &iov, 1, offset) == n ? n : -1;
+}
+
+// Move up to n bytes from file in to file out inside the kernel,
+// without copying the data through a user-space buffer.
+// Data is staged in a kernel page between fileread() and filewrite(),
+// so inode and pipe endpoints can be freely combined.
+// Stop at end of file, or after the first short read from a pipe.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  int r, n1, total;
+  char *buf;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if((buf = kalloc()) == 0)
+    return -1;
+
+  r = total = 0;
+  while(total < n){
+    n1 = n - total;
+    if(n1 > PGSIZE)
+      n1 = PGSIZE;
+
+    if((r = fileread(in, buf, n1)) <= 0)
+      break;
+    if(filewrite(out, buf, r) != r){
+      r = -1;
+      break;
+    }
+    total += r;
+
+    // Do not block on an empty pipe after a partial transfer.
+    if(r < n1 && in->type == FD_PIPE)
+      break;
+  }
+
+  kfree(buf);
+  return r < 0 && total == 0 ? -1 : total;
+}
+
+// Manipulate file descriptor properties.
+int
+filefcntl(struct file *f, int cmd, int arg)
+{
+  switch(cmd){
+  case F_GETPIPE_SZ:
+    if(f->type == FD_PIPE)
+      return pipesize(f->pipe);
+    return -1;
+  case F_SETPIPE_SZ:
+    if(f->type == FD_PIPE)
+      return pipesetsize(f->pipe, arg);
+    return -1;
+  }
+  return -1;
+}
+
+// Read inode ip at *off into segments iov, all under one lock hold
+// if lock is set. Stop at the first short segment.
+static int
+inodereadv(struct inode *ip, struct iovec *iov, int cnt, uint *off, int lock)
+{
+  int i, r, total;
+
+  total = 0;
+  if(lock)
+    ilock(ip);
+  for(i = 0; i < cnt; i++){
+    if((r = readi(ip, iov[i].iov_base, *off, iov[i].iov_len)) < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    *off += r;
+    total += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  if(lock)
+    iunlock(ip);
+  return total;
+}
+
+// Write segments iov to inode ip at *off.
+// Segments are packed into as few log transactions as fit,
+// each of them written under a single lock hold if lock is set.
+static int
+inodewritev(struct inode *ip, struct iovec *iov, int cnt, uint *off, int lock)
+{
+  // Same transaction limit as filewrite.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  int i, done, room, n1, r, total;
+
+  i = done = total = 0;
+  while(i < cnt){
+    begin_op();
+    if(lock)
+      ilock(ip);
+    for(room = max; i < cnt && room > 0; ){
+      n1 = iov[i].iov_len - done;
+      if(n1 > room)
+        n1 = room;
+      if(n1 > 0){
+        if((r = writei(ip, (char*)iov[i].iov_base + done, *off, n1)) != n1){
+          if(lock)
+            iunlock(ip);
+          end_op();
+          return -1;
+        }
+        *off += r;
+        done += r;
+        room -= r;
+        total += r;
+      }
+      if(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    if(lock)
+      iunlock(ip);
+    end_op();
+  }
+  return total;
+}
+
+// Read from file f into segments iov.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  struct range *rg;
+  int i, r, total;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    rg = lockrange(f->ip, f->off, iovend(iov, cnt, f->off), RANGE_SHARED);
+    total = inodereadv(f->ip, iov, cnt, &f->off, 1);
+    unlockrange(f->ip, rg);
+    return total;
+  }
+  if(f->type == FD_PIPE){
+    // Do not block again after a short read.
+    for(i = total = 0; i < cnt; i++){
+      if((r = piperead(f->pipe, iov[i].iov_base, iov[i].iov_len)) < 0)
+        return total ? total : -1;
+      total += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    return total;
+  }
+  panic("filereadv");
+}
+
+// Write segments iov to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  struct range *rg;
+  int i, total;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    rg = lockrange(f->ip, f->off, iovend(iov, cnt, f->off), RANGE_EXCL);
+    total = inodewritev(f->ip, iov, cnt, &f->off, 1);
+    unlockrange(f->ip, rg);
+    return total;
+  }
+  if(f->type == FD_PIPE){
+    for(i = total = 0; i < cnt; i++){
+      if(pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len) < 0)
+        return -1;
+      total += iov[i].iov_len;
+    }
+    return total;
+  }
+  panic("filewritev");
+}
+
+// Byte range [off, off + total length of iov), clamped at the top.
+static uint
+iovend(struct iovec *iov, int cnt, uint off)
+{
+  uint end;
+  int i;
+
+  end = off;
+  for(i = 0; i < cnt; i++){
+    if(end + iov[i].iov_len < end)
+      return 0xFFFFFFFF;
+    end += iov[i].iov_len;
+  }
+  return end;
+}
+
+// Read from file f into segments iov without updating offset.
+// Regular files are read under a shared range lock only, so that
+// positional reads and writes of other ranges run concurrently.
+// Blocks below ip->size are allocated for good while the file is
+// open, and the buffer cache serializes access to each block.
+int
+filepreadv(struct file *f, struct iovec *iov, int cnt, int offset)
+{
+  struct inode *ip = f->ip;
+  struct range *r;
+  uint off;
+  int n;
+
   // Accept only inode.
   if (f->readable == 0 || f->type != FD_INODE)
     return -1;
 
-  ilock(f->ip);
-  // Do not update f->off, only return number of read bytes.
-  r = readi(f->ip, addr, f->off + offset, n);
-  iunlock(f->ip);
-  return r;
+  off = f->off + offset;
+  if(ip->type != T_FILE)
+    return inodereadv(ip, iov, cnt, &off, 1);
+
+  r = acquirerange(&ip->rlock, off, iovend(iov, cnt, off), RANGE_SHARED);
+  n = inodereadv(ip, iov, cnt, &off, 0);
+  releaserange(&ip->rlock, r);
+  return n;
 }
 
-// Write to file f without update offset.
+// Write segments iov to file f without updating offset.
+// The range is locked exclusively. The inode lock is taken only
+// when the write extends the file, which changes size and may
+// allocate blocks; size never shrinks while the file is open.
 int
-filepwrite(struct file *f, char *addr, int n, int offset)
+filepwritev(struct file *f, struct iovec *iov, int cnt, int offset)
 {
-  int r;
+  struct inode *ip = f->ip;
+  struct range *r;
+  uint off, end;
+  int n;
+
   // Accept only inode.
   if (f->writable == 0 || f->type != FD_INODE)
     return -1;
 
-  // write a few blocks at a time to avoid exceeding
-  // the maximum log transaction size, including
-  // i-node, indirect block, allocation blocks,
-  // and 2 blocks of slop for non-aligned writes.
-  // this really belongs lower down, since writei()
-  // might be writing a device like the console.  
-  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-  int i = 0;
-  int off = f->off + offset;
-
-  // lock before loop, make write operation thread-safe
-  begin_op();
-  ilock(f->ip);
-
-  while (i < n) {
-    int n1 = n - i;
-    if (n1 > max)
-      n1 = max;
-
-    if ((r = writei(f->ip, addr + i, off, n1)) > 0)
-      // do not update f->off
-      off += r;
-    
-    if (r < 0)
-      break;
-    if (r != n1)
-      panic("short filewrite");
-    
-    i += r;
-  }
-
-  iunlock(f->ip);
-  end_op();
+  off = f->off + offset;
+  if(ip->type != T_FILE)
+    return inodewritev(ip, iov, cnt, &off, 1);
 
-  return i == n ? n : -1;
-}
\ No newline at end of file
+  end = iovend(iov, cnt, off);
+  r = acquirerange(&ip->rlock, off, end, RANGE_EXCL);
+  n = inodewritev(ip, iov, cnt, &off, end > ip->size);
+  releaserange(&ip->rlock, r);
+  return n;
+}
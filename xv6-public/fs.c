@@ -17,6 +17,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "rangelock.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -176,6 +177,7 @@ iinit(int dev)
   initlock(&icache.lock, "icache");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
+    initrangelock(&icache.inode[i].rlock, "inode");
   }
 
   readsb(dev, &sb);
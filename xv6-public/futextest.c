@@ -0,0 +1,218 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD   4
+#define NITER     20000   // increments per thread
+#define NITEM     1000    // items through the queue
+#define QSIZE     8
+#define NPHASE    50
+
+int mutextest(void);
+int condtest(void);
+int barriertest(void);
+int wordtest(void);
+
+int (*testfunc[])(void) = {
+  mutextest,
+  condtest,
+  barriertest,
+  wordtest,
+};
+char *testname[] = {
+  "mutextest",
+  "condtest",
+  "barriertest",
+  "wordtest",
+};
+
+mutex_t lock;
+cond_t notempty, notfull;
+barrier_t barrier;
+int counter;
+int queue[QSIZE];
+int head, tail;
+int arrived[NPHASE];
+
+// Run fn on NTHREAD threads and join them.
+// Return -1 if any of them returned nonzero.
+int
+runthreads(void*(*fn)(void*))
+{
+  int i, ret;
+  void *retval;
+  thread_t tid[NTHREAD];
+
+  for (i = 0; i < NTHREAD; i++) {
+    if (thread_create(&tid[i], fn, (void*)i) != 0) {
+      printf(1, "thread_create failed\n");
+      return -1;
+    }
+  }
+  ret = 0;
+  for (i = 0; i < NTHREAD; i++) {
+    if (thread_join(tid[i], &retval) != 0 || retval != 0)
+      ret = -1;
+  }
+  return ret;
+}
+
+// ============================================================================
+void*
+mutexthreadmain(void *arg)
+{
+  int i, tmp;
+
+  for (i = 0; i < NITER; i++) {
+    mutex_lock(&lock);
+    tmp = counter;
+    // Give other threads a chance to run inside the section.
+    if (i % 1000 == 0)
+      yield();
+    counter = tmp + 1;
+    mutex_unlock(&lock);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int
+mutextest(void)
+{
+  mutex_init(&lock);
+  counter = 0;
+  if (runthreads(mutexthreadmain) != 0)
+    return -1;
+  if (counter != NTHREAD * NITER) {
+    printf(1, "counter %d, expected %d\n", counter, NTHREAD * NITER);
+    return -1;
+  }
+  if (mutex_trylock(&lock) != 0 || mutex_trylock(&lock) != -1)
+    return -1;
+  mutex_unlock(&lock);
+  return 0;
+}
+
+// ============================================================================
+// Thread 0 produces items, the others consume them and sum them up.
+void*
+condthreadmain(void *arg)
+{
+  int i, item;
+
+  if ((int)arg == 0) {
+    for (i = 1; i <= NITEM; i++) {
+      mutex_lock(&lock);
+      while (tail - head == QSIZE)
+        cond_wait(&notfull, &lock);
+      queue[tail++ % QSIZE] = i;
+      cond_signal(&notempty);
+      mutex_unlock(&lock);
+    }
+    // End of stream, one marker per consumer.
+    for (i = 1; i < NTHREAD; i++) {
+      mutex_lock(&lock);
+      while (tail - head == QSIZE)
+        cond_wait(&notfull, &lock);
+      queue[tail++ % QSIZE] = 0;
+      cond_signal(&notempty);
+      mutex_unlock(&lock);
+    }
+    thread_exit(0);
+  }
+
+  for (;;) {
+    mutex_lock(&lock);
+    while (tail == head)
+      cond_wait(&notempty, &lock);
+    item = queue[head++ % QSIZE];
+    counter += item;
+    cond_signal(&notfull);
+    mutex_unlock(&lock);
+    if (item == 0)
+      break;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int
+condtest(void)
+{
+  mutex_init(&lock);
+  cond_init(&notempty);
+  cond_init(&notfull);
+  counter = head = tail = 0;
+  if (runthreads(condthreadmain) != 0)
+    return -1;
+  if (counter != NITEM * (NITEM + 1) / 2) {
+    printf(1, "sum %d, expected %d\n", counter, NITEM * (NITEM + 1) / 2);
+    return -1;
+  }
+  return 0;
+}
+
+// ============================================================================
+void*
+barrierthreadmain(void *arg)
+{
+  int i, last;
+
+  for (i = 0; i < NPHASE; i++) {
+    __sync_fetch_and_add(&arrived[i], 1);
+    last = barrier_wait(&barrier);
+    // Nobody passes before everyone arrived.
+    if (arrived[i] != NTHREAD)
+      thread_exit((void*)1);
+    if (last)
+      __sync_fetch_and_add(&counter, 1);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int
+barriertest(void)
+{
+  barrier_init(&barrier, NTHREAD);
+  counter = 0;
+  memset(arrived, 0, sizeof(arrived));
+  if (runthreads(barrierthreadmain) != 0)
+    return -1;
+  // Exactly one thread is the last one of each phase.
+  return counter == NPHASE ? 0 : -1;
+}
+
+// ============================================================================
+// Kernel side checks of the futex word.
+int
+wordtest(void)
+{
+  int word = 1;
+
+  if (futex_wait(&word, 0) != -1)
+    return -1;
+  if (futex_wait((int*)((char*)&word + 1), 1) != -1)
+    return -1;
+  if (futex_wait((int*)0x7ffffffc, 1) != -1)
+    return -1;
+  if (futex_wake(&word, 1) != 0)
+    return -1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  for (i = 0; i < sizeof(testfunc) / sizeof(testfunc[0]); i++) {
+    printf(1, "%d. %s start\n", i, testname[i]);
+    if (testfunc[i]() != 0) {
+      printf(1, "%d. %s panic\n", i, testname[i]);
+      exit();
+    }
+    printf(1, "%d. %s finish\n", i, testname[i]);
+  }
+  exit();
+}
@@ -0,0 +1,91 @@
+/**
+ *  This program measures the response time of a pipe under cpu hogs.
+ * A process first spins until it reaches the lowest MLFQ level, then
+ * sends bytes to an echo child through pipes and times the round
+ * trips. Waiting for the replies should lift it back up level by
+ * level, and the later round trips should be faster than the first.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "rusage.h"
+
+#define NHOG        3       // background cpu hogs
+#define NROUND      200     // round trips measured
+#define NSLICE      4       // parts the round trips are reported in
+#define SPINTICKS   300     // (ticks) spin limit to reach the bottom
+#define HOGTICKS    1000    // (ticks) lifetime of a hog
+
+void
+spin(int ticks)
+{
+  int start = uptime();
+
+  while (uptime() - start < ticks)
+    ;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage ru;
+  int i, slice, start, hogs[NHOG], toecho[2], fromecho[2];
+  uint64 begin, sum, max, rtt;
+  uint avg, worst;
+  char c;
+
+  for (i = 0; i < NHOG; ++i) {
+    if ((hogs[i] = fork()) == 0) {
+      spin(HOGTICKS);
+      exit();
+    }
+  }
+  if (pipe(toecho) < 0 || pipe(fromecho) < 0) {
+    printf(1, "iolat: pipe failed\n");
+    exit();
+  }
+  if (fork() == 0) {
+    close(toecho[1]);
+    close(fromecho[0]);
+    while (read(toecho[0], &c, 1) == 1)
+      write(fromecho[1], &c, 1);
+    exit();
+  }
+  close(toecho[0]);
+  close(fromecho[1]);
+
+  start = uptime();
+  while (getlev() < 2 && uptime() - start < SPINTICKS)
+    ;
+  printf(1, "level %d before the round trips\n", getlev());
+
+  getrusage(&ru);
+  for (slice = 0; slice < NSLICE; ++slice) {
+    sum = max = 0;
+    for (i = 0; i < NROUND / NSLICE; ++i) {
+      begin = rdtsc();
+      write(toecho[1], "x", 1);
+      read(fromecho[0], &c, 1);
+      rtt = rdtsc() - begin;
+      sum += rtt;
+      if (rtt > max)
+        max = rtt;
+    }
+    // Report in hundredths of a tick.
+    avg = (uint)udiv64(sum * 100, ru.tscpertick) / (NROUND / NSLICE);
+    worst = udiv64(max * 100, ru.tscpertick);
+    printf(1, "round trips %d-%d: level %d, avg %d, max %d (1/100 tick)\n",
+           slice * NROUND / NSLICE, (slice + 1) * NROUND / NSLICE - 1,
+           getlev(), avg, worst);
+  }
+
+  close(toecho[1]);
+  wait();
+  for (i = 0; i < NHOG; ++i)
+    kill(hogs[i]);
+  for (i = 0; i < NHOG; ++i)
+    wait();
+  exit();
+}
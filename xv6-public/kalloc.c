@@ -21,6 +21,8 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int nfree;              // number of pages on freelist
+  uchar ref[PHYSTOP / PGSIZE];  // mappings of a page shared by kdup
 } kmem;
 
 // Initialization happens in two phases.
@@ -64,6 +66,19 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  // Shared page goes when its last mapping does.
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) / PGSIZE] > 1){
+    kmem.ref[V2P(v) / PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v) / PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -72,6 +87,7 @@ kfree(char *v)
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
@@ -87,10 +103,42 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+    kmem.ref[V2P(r) / PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Take another reference to page v, which kfree then drops.
+void
+kdup(char *v)
+{
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) / PGSIZE] == 0xFF)
+    panic("kdup");
+  kmem.ref[V2P(v) / PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Number of references to page v.
+int
+krefs(char *v)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[V2P(v) / PGSIZE];
+  release(&kmem.lock);
+  return n;
+}
+
+// Number of free pages.
+int
+kfreepages(void)
+{
+  return kmem.nfree;
+}
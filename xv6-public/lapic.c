@@ -113,6 +113,27 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send interrupt vector to the cpu of given APIC id.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | DEASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Stop or restart the periodic timer of this cpu.
+void
+lapictimer(int on)
+{
+  if(!lapic)
+    return;
+  lapicw(TIMER, (on ? 0 : MASKED) | PERIODIC | (T_IRQ0 + IRQ_TIMER));
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
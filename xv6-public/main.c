@@ -27,9 +27,11 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  traceinit();     // scheduler trace
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  mmapinit();      // shared file pages
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -8,6 +8,13 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// User address space above the heap
+#define MMAPBASE 0x40000000         // First address of file mappings
+#define MMAPTOP  STACKBASE          // End of file mappings
+#define STACKBASE 0x70000000        // First address of thread stacks
+#define STACKTOP 0x7FFFF000         // End of thread stacks
+#define TIMEPAGE 0x7FFFF000         // Read-only time page, below KERNBASE
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
 
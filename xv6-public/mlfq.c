@@ -7,19 +7,26 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "trace.h"
+#include "mlfqparam.h"
 
-extern int sys_uptime(void);
 
 static struct proc* MLFQ_PROC = (struct proc*)-1;
 
-// Check whether given process has runnable threads.
+// Check whether given process has runnable threads
+// that may run on this cpu.
 static int
 runnable(struct proc* p) {
-  struct thread* t;
-  for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-    if (t->state == RUNNABLE)
-      return t - p->threads;
-  return -1;
+  return p->runq != 0 && runqfirst(p, mycpu()) != 0;
+}
+
+// Check whether entry idx of stride scheduler can run.
+static int
+stride_runnable(struct stride* this, int idx) {
+  struct thread* t = this->thread[idx];
+  if (t)
+    return t->state == RUNNABLE && cpuallowed(t, mycpu());
+  return runnable(this->queue[idx]);
 }
 
 // Initialize stride scheduler.
@@ -34,6 +41,8 @@ stride_init(struct stride* this) {
   // Initialize MLFQ scheduler
   this->quantum = 5;
   this->total = 0;
+  this->maxtotal = MAXSTRIDE;
+  this->vtime = 0;
   this->pass[0] = 0;
   this->ticket[0] = MAXTICKET;
   this->queue[0] = MLFQ_PROC;
@@ -44,47 +53,58 @@ stride_init(struct stride* this) {
     this->ticket[i] = 0;
     this->queue[i] = 0;
   }
+  for (i = 0; i < NPROC; ++i)
+    this->thread[i] = 0;
+}
+
+// Find empty entry of stride scheduler, 0 if full.
+static int
+stride_slot(struct stride* this) {
+  struct proc** iter;
+  for (iter = this->queue; iter != &this->queue[NPROC]; ++iter)
+    if (*iter == 0)
+      return iter - this->queue;
+  return 0;
+}
+
+// Start entry idx with given tickets.
+// Pass value begins from the virtual time, so that the stale pass
+// value of a sleeping entry gives it no head start.
+static void
+stride_start(struct stride* this, int idx, int usage) {
+  this->ticket[idx] = usage;
+  this->pass[idx] = this->vtime;
+}
+
+// Entry idx becomes runnable again. It gave its share to the others
+// while it slept, so move its pass value up to the virtual time
+// instead of letting it catch up on the cpu.
+void
+stride_wake(struct stride* this, int idx) {
+  if (this->ticket[idx] && this->pass[idx] < this->vtime)
+    this->pass[idx] = this->vtime;
 }
 
 // Append process to the stride scheduler with given proportion of cpu usage.
 int
 stride_append(struct stride* this, struct proc* p, int usage) {
   int idx;
-  float minpass;
-  float* pass;
-  struct proc** iter;
   // If total proprotion exceeds maximum stride scheduling.
-  if (this->total + usage > MAXSTRIDE || usage <= 0)
+  if (this->total + usage > this->maxtotal || usage <= 0)
     return 0;
 
   // Find empty space.
-  for (iter = this->queue; iter != &this->queue[NPROC]; ++iter)
-    if (*iter == 0)
-      goto found;
-
-  return 0;
+  if ((idx = stride_slot(this)) == 0)
+    return 0;
 
-found:
-  idx = iter - this->queue;
   // Set scheduler information in process.
   p->mlfq.level = -1;
   p->mlfq.index = idx;
 
-  *iter = p;
+  this->queue[idx] = p;
   this->total += usage;
   this->ticket[0] -= usage;
-  this->ticket[idx] = usage;
-
-  // Set pass value of given process
-  // with minimum pass value between existing processes.
-  minpass = this->pass[0];
-  for (pass = this->pass + 1; pass != &this->pass[NPROC]; ++pass) {
-    if (*pass != -1 && minpass > *pass) {
-      minpass = *pass;
-    }
-  }
-
-  this->pass[idx] = minpass;
+  stride_start(this, idx, usage);
   return 1;
 }
 
@@ -101,46 +121,87 @@ stride_delete(struct stride* this, struct proc* p) {
   this->queue[idx] = 0;
 }
 
-// Update pass value of given process.
-int
-stride_update(struct stride* this, struct proc* p) {
-  int idx;
+// Update pass value of entry idx, which ran for given cycles.
+// A run of a whole quantum advances the pass by the stride.
+static int
+stride_pass(struct stride* this, int idx, uint64 ran) {
   float* pass;
-  if (p == MLFQ_PROC)
-    idx = 0;
-  else
-    idx = p->mlfq.index;
+  struct proc* p = this->queue[idx];
+  struct thread* t = this->thread[idx];
+  // Entry may be gone while it ran.
+  if (this->ticket[idx] == 0)
+    return MLFQ_NEXT;
 
-  this->pass[idx] += (float)MAXTICKET / this->ticket[idx];
+  if (ran > 0xFFFFFFFF)
+    ran = 0xFFFFFFFF;
+  this->pass[idx] += (float)MAXTICKET / this->ticket[idx]
+    * ((float)(uint)ran / ((float)this->quantum * tscpertick));
+  trace(TRACE_PASS, p && p != MLFQ_PROC ? p->pid : 0, t ? t->tid : 0,
+        (int)this->pass[idx]);
 
   // If pass value exceeds maximum pass value,
   // substract all pass value with predefined scaling term
   // to maintain them in sufficient range.
-  if (this->pass[idx] > MAXPASS)
+  if (this->pass[idx] > MAXPASS) {
     for (pass = this->pass; pass != this->pass + NPROC; ++pass)
       if (*pass > 0)
         *pass -= MAXPASS - SCALEPASS;
+    if (this->vtime > 0)
+      this->vtime -= MAXPASS - SCALEPASS;
+  }
 
   return MLFQ_NEXT;
 }
 
+// Update pass value of given process, which ran for given cycles.
+int
+stride_update(struct stride* this, struct proc* p, uint64 ran) {
+  if (p == MLFQ_PROC)
+    return stride_pass(this, 0, ran);
+  return stride_pass(this, p->mlfq.index, ran);
+}
+
+// Get runnable entry with minimum pass value, starting from entry
+// idx, or -1 to start from none. Return -1 if there is none.
+static int
+stride_min(struct stride* this, int idx) {
+  int i;
+
+  for (i = 1; i < NPROC; ++i)
+    if (this->pass[i] != -1 && (idx < 0 || this->pass[idx] > this->pass[i]))
+      if (stride_runnable(this, i))
+        idx = i;
+  return idx;
+}
+
 // Get next process based on stride scheduling policy.
-// Write runnable thread index if exists.
+// Write the thread to run if the entry is a thread share, else 0.
 struct proc*
-stride_next(struct stride* this, int* tidx) {
-  int idx;
-  float* iter;
-  float* minpass = this->pass;
-
-  // Get process which is runnable and have minimum pass value.
-  for (iter = this->pass + 1; iter != &this->pass[NPROC]; ++iter)
-    if (*iter != -1 && *minpass > *iter)
-      if ((idx = runnable(this->queue[iter - this->pass])) != -1) {
-        minpass = iter;
-        *tidx = idx;
-      }
+stride_next(struct stride* this, struct thread** t) {
+  // MLFQ scheduler is taken as runnable, see stride_skip.
+  int idx = stride_min(this, 0);
+
+  this->vtime = this->pass[idx];
+  *t = this->thread[idx];
+  return this->queue[idx];
+}
 
-  return this->queue[minpass - this->pass];
+// MLFQ scheduler has nothing to run on this cpu. Give its turn to
+// the runnable entry with minimum pass value, or 0 if there is none,
+// without charging it. Like a sleeping entry, it does not keep
+// the time it leaves to the others.
+struct proc*
+stride_skip(struct stride* this, struct thread** t) {
+  int idx = stride_min(this, -1);
+
+  *t = 0;
+  if (idx < 0)
+    return 0;
+  this->vtime = this->pass[idx];
+  if (this->pass[0] < this->vtime)
+    this->pass[0] = this->vtime;
+  *t = this->thread[idx];
+  return this->queue[idx];
 }
 
 // Initialize MLFQ scheduler. 
@@ -153,14 +214,24 @@ mlfq_init(struct mlfq* this)
   static const uint quantum[] = { 5, 10, 20 };
   static const uint expire[] = { 20, 40, 200 };
 
+  // Defaults, setmlfqparam may change them at run time.
+  this->nlevel = NELEM(quantum);
   for (i = 0; i < NMLFQ; ++i) {
-    this->quantum[i] = quantum[i];
-    this->expire[i] = expire[i];
+    this->quantum[i] = i < this->nlevel ? quantum[i] : 0;
+    this->expire[i] = i < this->nlevel ? expire[i] : 0;
     for (j = 0; j < NPROC; ++j, ++iter)
       *iter = 0;
 
     this->iterstate[i] = this->queue[i];
   }
+  this->boost = expire[this->nlevel - 1];
+  this->boostcheck = 0;
+  this->boostcursor = 0;
+  this->nlend = 0;
+
+  for (i = 0; i < NPROC; ++i)
+    this->edf[i] = 0;
+  this->edftotal = 0;
 
   // Stride scehduler acts as meta-scheduler,
   // which controls the cpu usage between MLFQ scheduling process
@@ -186,15 +257,149 @@ found:
   p->mlfq.level = level;
   p->mlfq.index = iter - this->queue[level];
   p->mlfq.elapsed = 0;
+  p->mlfq.since = ticks;
   return MLFQ_SUCCESS;
 }
 
+// Deadline of deadline process p at tick now,
+// counting the periods that passed.
+static uint
+edf_deadline(struct proc* p, uint now)
+{
+  if (now < p->edf.deadline)
+    return p->edf.deadline;
+  return p->edf.deadline
+    + ((now - p->edf.deadline) / p->edf.period + 1) * p->edf.period;
+}
+
+// Check whether deadline process p can run at tick now.
+// A new period refills the budget.
+static int
+edf_ready(struct proc* p, uint now)
+{
+  return runnable(p) && (p->edf.budget > 0 || now >= p->edf.deadline);
+}
+
+// Start the period of p that tick now is in, if the last one ended.
+// Ending it runnable with budget left is a missed deadline, if it
+// was already waiting for the cpu before the deadline tick. A task
+// waking at its release tick is on time.
+static void
+edf_refill(struct proc* p, uint now)
+{
+  if (now < p->edf.deadline)
+    return;
+  if (p->edf.budget > 0 && runnable(p) && p->edf.ready < p->edf.deadline) {
+    p->edf.misses++;
+    trace(TRACE_MISS, p->pid, 0, p->edf.deadline);
+  }
+  p->edf.deadline = edf_deadline(p, now);
+  p->edf.budget = (uint64)p->edf.runtime * tscpertick;
+  p->edf.ready = now;
+}
+
+// Get the ready deadline process with the earliest deadline, or 0.
+static struct proc*
+edf_next(struct mlfq* this)
+{
+  uint now = ticks;
+  struct proc** iter;
+  struct proc* p;
+  struct proc* best = 0;
+
+  for (iter = this->edf; iter != &this->edf[NPROC]; ++iter) {
+    if ((p = *iter) == 0)
+      continue;
+    edf_refill(p, now);
+    if (edf_ready(p, now)
+        && (best == 0 || p->edf.deadline < best->edf.deadline))
+      best = p;
+  }
+  return best;
+}
+
+// Check whether a ready deadline process should take the cpu from
+// p, for being a deadline process of earlier deadline or p not being
+// one. Does not change the state, so it can run without ptable.lock.
+static int
+edf_preempts(struct mlfq* this, struct proc* p)
+{
+  uint now = ticks;
+  struct proc** iter;
+  struct proc* q;
+
+  if (this->edftotal == 0)
+    return 0;
+  for (iter = this->edf; iter != &this->edf[NPROC]; ++iter) {
+    if ((q = *iter) == 0 || q == p || !edf_ready(q, now))
+      continue;
+    if (p->mlfq.level != -2
+        || edf_deadline(q, now) < edf_deadline(p, now))
+      return 1;
+  }
+  return 0;
+}
+
+// Move p to the deadline class, to get runtime ticks of cpu every
+// period ticks, or back to MLFQ if runtime is 0. Deadline processes
+// may take at most MAXEDF percent of a cpu in total.
+// Return -1 if the process has a cpu share or it is not admitted.
+int
+mlfq_deadline(struct mlfq* this, struct proc* p, uint runtime, uint period)
+{
+  int level = p->mlfq.level;
+  int index = p->mlfq.index;
+  uint usage, old;
+  struct proc** iter;
+
+  if (level == -1)
+    return -1;
+  old = level == -2 ? p->edf.usage : 0;
+  if (runtime == 0) {
+    if (level != -2)
+      return 0;
+    this->edf[index] = 0;
+    this->edftotal -= old;
+    if (mlfq_append(this, p, 0) != MLFQ_SUCCESS)
+      panic("mlfq: deadline removal failed");
+    return 0;
+  }
+
+  // Admission control, rounding usage up.
+  if (runtime > period || period > 1000000)
+    return -1;
+  usage = (runtime * 1000 + period - 1) / period;
+  if (this->edftotal - old + usage > MAXEDF * 10)
+    return -1;
+
+  if (level != -2) {
+    for (iter = this->edf; *iter != 0; ++iter)
+      ;
+    this->queue[level][index] = 0;
+    *iter = p;
+    p->mlfq.level = -2;
+    p->mlfq.index = iter - this->edf;
+    p->edf.misses = 0;
+  }
+  p->edf.ready = ticks;
+  this->edftotal += usage - old;
+  p->edf.runtime = runtime;
+  p->edf.period = period;
+  p->edf.usage = usage;
+  p->edf.deadline = ticks + period;
+  p->edf.budget = (uint64)runtime * tscpertick;
+  return 0;
+}
+
 // Pass process to the stride scheduler.
 int
 mlfq_cpu_share(struct mlfq* this, struct proc* p, int usage)
 {
   int level = p->mlfq.level;
   int index = p->mlfq.index;
+  // Deadline process has its runtime instead.
+  if (level == -2)
+    return -1;
   if (!stride_append(&this->metasched, p, usage)) {
     return -1;
   }
@@ -203,6 +408,67 @@ mlfq_cpu_share(struct mlfq* this, struct proc* p, int usage)
   return 0;
 }
 
+// Give thread t of p its own share of cpu usage, or drop its
+// share if usage is 0. The share comes out of the share of p if p
+// is scheduled by the stride scheduler, else out of the stride limit.
+int
+mlfq_thread_share(struct mlfq* this, struct proc* p, struct thread* t, int usage)
+{
+  int idx;
+  int inproc = p->mlfq.level == -1;
+  struct stride* state = &this->metasched;
+
+  if (usage < 0)
+    return -1;
+  // Replace the previous share.
+  if (t->share.index)
+    mlfq_thread_unshare(this, p, t);
+  if (usage == 0)
+    return 0;
+
+  // Process keeps at least a ticket for its other threads.
+  if (inproc && state->ticket[p->mlfq.index] <= usage)
+    return -1;
+  if (!inproc && state->total + usage > state->maxtotal)
+    return -1;
+  if ((idx = stride_slot(state)) == 0)
+    return -1;
+
+  if (inproc) {
+    state->ticket[p->mlfq.index] -= usage;
+  } else {
+    state->total += usage;
+    state->ticket[0] -= usage;
+  }
+  state->queue[idx] = p;
+  state->thread[idx] = t;
+  stride_start(state, idx, usage);
+  t->share.index = idx;
+  t->share.inproc = inproc;
+  return 0;
+}
+
+// Give the share of thread t back to where it came from.
+void
+mlfq_thread_unshare(struct mlfq* this, struct proc* p, struct thread* t)
+{
+  int idx = t->share.index;
+  struct stride* state = &this->metasched;
+  int usage = state->ticket[idx];
+
+  if (t->share.inproc && p->mlfq.level == -1) {
+    state->ticket[p->mlfq.index] += usage;
+  } else {
+    state->total -= usage;
+    state->ticket[0] += usage;
+  }
+  state->pass[idx] = -1;
+  state->ticket[idx] = 0;
+  state->queue[idx] = 0;
+  state->thread[idx] = 0;
+  t->share.index = 0;
+}
+
 // Delete process from MLFQ scheduler.
 void
 mlfq_delete(struct mlfq* this, struct proc* p)
@@ -211,13 +477,18 @@ mlfq_delete(struct mlfq* this, struct proc* p)
   // it indicates that process is scheduled by stride scheduler.
   if (p->mlfq.level == -1)
     stride_delete(&this->metasched, p);
-  else
+  else if (p->mlfq.level == -2) {
+    this->edf[p->mlfq.index] = 0;
+    this->edftotal -= p->edf.usage;
+  } else
     this->queue[p->mlfq.level][p->mlfq.index] = 0;  
 }
 
 // Update process level by checking elapsed time.
+// share is the stride entry of the thread share that ran, or 0,
+// and ran is the length of the run in cycles.
 int
-mlfq_update(struct mlfq* this, struct proc* p, uint ctime)
+mlfq_update(struct mlfq* this, struct proc* p, int share, uint64 ran)
 {
   int level = p->mlfq.level;
   int index = p->mlfq.index;
@@ -226,24 +497,39 @@ mlfq_update(struct mlfq* this, struct proc* p, uint ctime)
   if (p->state == ZOMBIE || p->killed)
     return MLFQ_NEXT;
 
+  // Thread share is charged apart from its process.
+  if (share)
+    return stride_pass(&this->metasched, share, ran);
+
+  // Deadline process spends its budget, and EDF picks again.
+  if (level == -2) {
+    p->edf.budget -= ran < p->edf.budget ? ran : p->edf.budget;
+    p->edf.ready = ticks;
+    return MLFQ_NEXT;
+  }
+
   // If process level is -1, it indicates scheduled by stride scheduler.
   if (level == -1)
-    return stride_update(&this->metasched, p);
+    return stride_update(&this->metasched, p, ran);
 
   // Update pass value of MLFQ scheulder.
-  stride_update(&this->metasched, MLFQ_PROC);
+  stride_update(&this->metasched, MLFQ_PROC, ran);
   // If avilable time is expired, move the process to the next queue.
-  if (level + 1 < NMLFQ && p->mlfq.elapsed >= this->expire[level]) {
+  if (level + 1 < this->nlevel &&
+      p->mlfq.elapsed >= (uint64)this->expire[level] * tscpertick) {
     if (mlfq_append(this, p, level + 1) != MLFQ_SUCCESS)
       panic("mlfq: level elevation failed");
 
     // Remove from current level queue.
     this->queue[level][index] = 0;
+    trace(TRACE_DEMOTE, p->pid, 0, level + 1);
     return MLFQ_NEXT;
   }
 
-  // Check process use CPU time of RR time quantum.
-  if (ctime - p->mlfq.start < this->quantum[level])
+  // Check process use CPU time of RR time quantum,
+  // and leave the cpu to a ready deadline process.
+  if (ran < (uint64)this->quantum[level] * tscpertick
+      && !edf_preempts(this, p))
     return MLFQ_KEEP;
   else
     return MLFQ_NEXT;
@@ -251,15 +537,14 @@ mlfq_update(struct mlfq* this, struct proc* p, uint ctime)
 
 // Get next process with MLFQ scheduling policy.
 // If it returns zero, it means nothing runnaable.
-// Write runnable thread index to given argument `tidx`.
 struct proc*
-mlfq_next(struct mlfq* this, int* tidx)
+mlfq_next(struct mlfq* this)
 {
-  int i, flag, idx;
+  int i, flag;
   struct proc** iter;
   struct proc* p;
 
-  for (i = 0; i < NMLFQ; ++i) {
+  for (i = 0; i < this->nlevel; ++i) {
     // Use flag for enabling all sequence check.
     flag = 1;
     for (iter = this->iterstate[i] + 1;
@@ -271,12 +556,11 @@ mlfq_next(struct mlfq* this, int* tidx)
         iter = this->queue[i];
       // Just runnable process.
       p = *iter;
-      if (p == 0 || (idx = runnable(p)) == -1)
+      if (p == 0 || !runnable(p))
         continue;
       
       // Update iterator state and return process.
       this->iterstate[i] = iter;
-      *tidx = idx;
       return p;
     }
   }
@@ -285,112 +569,290 @@ mlfq_next(struct mlfq* this, int* tidx)
   return 0;
 }
 
-// Boost all process to the top level.
+// Boost processes that stayed below the top level for the boost
+// period. Every call looks at a part of the lower levels, in
+// proportion to the ticks since the last call, to go through all
+// of them once a period.
 void
-mlfq_boost(struct mlfq* this)
+mlfq_boost(struct mlfq* this, uint now)
 {
-  int found;
+  uint nslot = (this->nlevel - 1) * NPROC;
+  uint n;
+  struct proc** slot;
   struct proc* p;
-  struct proc** top = this->queue[0];
-  struct proc** lower = this->queue[1];
 
-  for (; lower != &this->queue[NMLFQ - 1][NPROC]; ++lower) {
-    if (*lower == 0)
+  if (nslot == 0 || now == this->boostcheck)
+    return;
+  if (now - this->boostcheck >= this->boost)
+    n = nslot;
+  else
+    n = (now - this->boostcheck) * nslot / this->boost + 1;
+  this->boostcheck = now;
+
+  // Lower levels follow each other in the queue array.
+  for (; n > 0; --n) {
+    if (++this->boostcursor >= nslot)
+      this->boostcursor = 0;
+    slot = &this->queue[1][this->boostcursor];
+    p = *slot;
+    if (p == 0 || now - p->mlfq.since < this->boost)
       continue;
+    if (mlfq_append(this, p, 0) != MLFQ_SUCCESS)
+      panic("mlfq boost: could not find empty space of toplevel queue");
+    *slot = 0;
+    trace(TRACE_BOOST, p->pid, 0, 0);
+  }
+}
+
+// Credit p with cycles it slept while none of its threads could run,
+// and promote it a level once the credit covers the whole allotment
+// of the upper level. mlfq_append gives it that allotment afresh, so
+// a process cannot climb faster than it leaves the cpu to others,
+// and a wakeup promotes it at most one level.
+void
+mlfq_wake(struct mlfq* this, struct proc* p, uint64 slept)
+{
+  int level = p->mlfq.level;
+  int index = p->mlfq.index;
+  uint64 cost, max;
 
-    found = 0;
-    // Find empty space on top level.
-    for (; top != &this->queue[0][NPROC]; ++top) {
-      if (*top != 0)
+  // Stride scheduled process does not catch up on its sleep.
+  if (level == -1)
+    stride_wake(&this->metasched, index);
+  // Deadline process waits for the cpu from now on.
+  if (level == -2)
+    p->edf.ready = ticks;
+  // Stride or deadline scheduled, or already at the top.
+  if (level <= 0)
+    return;
+  cost = (uint64)this->expire[level - 1] * tscpertick;
+  // Credit is kept up to a boost period, or the cost if longer.
+  max = (uint64)this->boost * tscpertick;
+  if (max < cost)
+    max = cost;
+  p->mlfq.credit += slept;
+  if (p->mlfq.credit > max)
+    p->mlfq.credit = max;
+  if (p->mlfq.credit < cost)
+    return;
+  if (mlfq_append(this, p, level - 1) != MLFQ_SUCCESS)
+    return;
+  this->queue[level][index] = 0;
+  p->mlfq.credit -= cost;
+  trace(TRACE_PROMOTE, p->pid, 0, level - 1);
+}
+
+// Move holder of a lock that waiter waits for up to the level of
+// waiter, if it is lower. It then gets the cpu as often as waiter
+// would, and is demoted again by its own use of the new level.
+// Return 1 if holder was moved.
+int
+mlfq_lend(struct mlfq* this, struct proc* holder, struct proc* waiter)
+{
+  int level = holder->mlfq.level;
+  int index = holder->mlfq.index;
+  // Stride and deadline scheduling waiters count as the top level.
+  int to = waiter->mlfq.level < 0 ? 0 : waiter->mlfq.level;
+
+  // Stride and deadline scheduling holders have their share anyway.
+  if (level < 0 || level <= to || holder->state != RUNNABLE)
+    return 0;
+  if (mlfq_append(this, holder, to) != MLFQ_SUCCESS)
+    return 0;
+  this->queue[level][index] = 0;
+  this->nlend++;
+  trace(TRACE_LEND, holder->pid, 0, to);
+  return 1;
+}
+
+// Read the scheduler parameters.
+void
+mlfq_getparam(struct mlfq* this, struct mlfqparam* param)
+{
+  int i;
+
+  param->nlevel = this->nlevel;
+  for (i = 0; i < NMLFQ; ++i) {
+    param->quantum[i] = this->quantum[i];
+    param->expire[i] = this->expire[i];
+  }
+  param->boost = this->boost;
+  param->stridequantum = this->metasched.quantum;
+  param->maxstride = this->metasched.maxtotal;
+}
+
+// Apply parameters to the running scheduler. Processes on levels
+// that are gone move to the new lowest level.
+// Return -1 if a parameter is out of range.
+int
+mlfq_setparam(struct mlfq* this, struct mlfqparam* param)
+{
+  int i, level;
+  struct proc** iter;
+  struct stride* state = &this->metasched;
+
+  if (param->nlevel < 1 || param->nlevel > NMLFQ)
+    return -1;
+  for (i = 0; i < param->nlevel; ++i)
+    if (param->quantum[i] == 0 || param->expire[i] == 0)
+      return -1;
+  if (param->boost == 0 || param->stridequantum == 0)
+    return -1;
+  // MLFQ keeps at least a ticket, and present shares stay.
+  if (param->maxstride >= MAXTICKET || param->maxstride < state->total)
+    return -1;
+
+  for (i = 0; i < NMLFQ; ++i) {
+    this->quantum[i] = i < param->nlevel ? param->quantum[i] : 0;
+    this->expire[i] = i < param->nlevel ? param->expire[i] : 0;
+  }
+  this->boost = param->boost;
+  this->boostcursor = 0;
+  state->quantum = param->stridequantum;
+  state->maxtotal = param->maxstride;
+
+  level = param->nlevel - 1;
+  for (i = param->nlevel; i < this->nlevel; ++i) {
+    for (iter = this->queue[i]; iter != &this->queue[i][NPROC]; ++iter) {
+      if (*iter == 0)
         continue;
-      
-      // Move lower proceee to the top level.
-      *top = *lower;
-      *lower = 0;
-      // Update scheduler information.
-      p = *top;
-      p->mlfq.level = 0;
-      p->mlfq.index = top - this->queue[0];
-      p->mlfq.elapsed = 0;
-
-      found = 1;
-      break;
+      if (mlfq_append(this, *iter, level) != MLFQ_SUCCESS)
+        panic("mlfq: level removal failed");
+      *iter = 0;
     }
+    this->iterstate[i] = this->queue[i];
+  }
+  this->nlevel = param->nlevel;
+  return 0;
+}
 
-    if (!found)
-      panic("mlfq boost: could not find empty space of toplevel queue");
+// Halt the cpu until an interrupt arrives,
+// unless cpukick took back its idle announcement.
+static void
+mlfq_halt(struct cpu* c)
+{
+  // Cpu 0 keeps counting ticks, others may stop their timer.
+  int tickless = TICKLESS && c != &cpus[0];
+
+  cli();
+  if (c->idle) {
+    if (tickless)
+      lapictimer(0);
+    stihlt();
+    if (tickless)
+      lapictimer(1);
   }
+  c->idle = 0;
 }
 
 // MLFQ scheduler.
 void
 mlfq_scheduler(struct mlfq* this, struct spinlock* lock)
 {
-  int keep, idx;
-  uint start, end, boost, boostunit;
+  int keep, share, idle;
+  uint64 start, end;
+  pde_t* loaded;
   struct proc* p = 0;
+  struct thread* t;
+  struct thread* pick;
   struct cpu* c = mycpu();
   struct stride* state = &this->metasched;
 
-  idx = 0;
   c->proc = 0;
-  boostunit = this->expire[NMLFQ - 1];
+  c->thread = 0;
 
   keep = MLFQ_NEXT;
-  boost = boostunit;
   for (;;) {
     // Enable interrupts.
     sti();
 
     acquire(lock);
+    // Announce before looking for work, so that
+    // a thread queued meanwhile kicks us out of hlt.
+    xchg(&c->idle, 1);
+    idle = 0;
+    loaded = 0;
     do {
+      pick = 0;
       // If previous run commands replace the proc or
       // current process is not runnable.
-      if (keep == MLFQ_NEXT || p->threads[p->tidx].state != RUNNABLE) {
-        // Get next process from method to run.
-        p = stride_next(state, &idx);
+      if (keep == MLFQ_NEXT || !runnable(p)) {
+        // Deadline processes come first, then the stride
+        // scheduler picks between its processes and MLFQ.
+        if ((p = edf_next(this)) == 0)
+          p = stride_next(state, &pick);
         // If given process is MLFQ scheduler,
-        // request a new process.
-        if (p == MLFQ_PROC)
-          p = mlfq_next(this, &idx);
+        // request a new process, else run a stride process.
+        if (p == MLFQ_PROC && (p = mlfq_next(this)) == 0)
+          p = stride_skip(state, &pick);
 
         // If there is nothing runnable.
         if (p == 0) {
-          // Update MLFQ pass value for preventing deadlock.
-          keep = stride_update(state, MLFQ_PROC);
+          keep = MLFQ_NEXT;
+          idle = 1;
           break;
         }
-
-        // Update index of the current running thread.
-        p->tidx = idx;
       }
 
-      // Switch to chosen process.
+      // Switch to the thread picked for its own share,
+      // else to the first thread of the run queue.
       // It is the process's job to relase ptable.lock
       // and then reacquire it before jumping back to us.
+      if ((t = runqpop(p, pick)) == 0) {
+        // Taken by a sibling thread meanwhile.
+        keep = MLFQ_NEXT;
+        break;
+      }
+      // Thread may give the cpu away, so remember its entry.
+      share = pick ? pick->share.index : 0;
       c->proc = p;
-      switchuvm(p);
-      p->threads[p->tidx].state = RUNNING;
-
-      start = sys_uptime();
+      c->thread = t;
+      t->lastcpu = c - cpus;
+      c->pinned = share != 0;
+      c->idle = 0;
+      // Same address space is still loaded if p keeps the cpu.
+      if (loaded == p->pgdir)
+        switch_trap_kstack(p);
+      else
+        switchuvm(p);
+
+      start = rdtsc();
       p->mlfq.start = start;
-      swtch(&(c->scheduler), p->threads[p->tidx].context);
-      switchkvm();
-
-      // Update MLFQ states.
-      end = sys_uptime();
-      p->mlfq.elapsed += end - start;
-      keep = mlfq_update(this, p, end);
-
-      // If boosting time arrived.
-      if (end > boost) {
-        mlfq_boost(this);
-        boost += boostunit;
-      }
+      c->tscstart = start;
+      c->handoff = lock;
+      trace(TRACE_SWITCHIN, p->pid, t->tid, share ? -1 : p->mlfq.level);
+      swtch(&(c->scheduler), t->context);
+      // Holding ptable.lock, p cannot be freed and its page table
+      // may stay loaded until we know the next process.
+      loaded = p->pgdir;
+
+      // Charge the thread giving the cpu back, whichever sibling
+      // it is, and the whole run to the process or thread share.
+      end = rdtsc();
+      c->thread->runtime += end - c->tscstart;
+      trace(TRACE_SWITCHOUT, p->pid, c->thread->tid,
+            (int)(end - c->tscstart));
+      if (!share)
+        p->mlfq.elapsed += end - start;
+      keep = mlfq_update(this, p, share, end - start);
+
+      // Boost processes whose time has come.
+      mlfq_boost(this, ticks);
 
       c->proc = 0;
-    } while (0);
+      c->thread = 0;
+      c->pinned = 0;
+      // Run p again without leaving ptable.lock if it keeps the cpu.
+    } while (keep == MLFQ_KEEP && runnable(p));
+    if (loaded)
+      switchkvm();
     release(lock);
+
+    // Leave ptable.lock to busy cpus until there is work.
+    if (idle) {
+      trace(TRACE_IDLE, 0, 0, 0);
+      mlfq_halt(c);
+    }
   }
 }
 
@@ -401,7 +863,7 @@ mlfq_log(struct mlfq* this, int maxproc)
   int i, j;
   struct stride* stride = &this->metasched;
   cprintf("----------\n");
-  cprintf("tick: %d\n", sys_uptime());
+  cprintf("tick: %d\n", ticks);
   for (i = 0; i < maxproc; ++i) {
     cprintf("%p(", stride->queue[i]);
     if (stride->queue[i] != MLFQ_PROC && stride->queue[i]) {
@@ -414,7 +876,7 @@ mlfq_log(struct mlfq* this, int maxproc)
     for (j = 0; j < maxproc; ++j) {
       cprintf("%p(", this->queue[i][j]);
       if (this->queue[i][j])
-        cprintf("%s, %d, %d", this->queue[i][j]->name, this->queue[i][j]->mlfq.start, this->queue[i][j]->mlfq.elapsed);
+        cprintf("%s, %d, %d", this->queue[i][j]->name, (uint)this->queue[i][j]->mlfq.start, (uint)this->queue[i][j]->mlfq.elapsed);
       cprintf(") ");
     }
     cprintf("\n");
@@ -425,11 +887,22 @@ mlfq_log(struct mlfq* this, int maxproc)
 int
 mlfq_yieldable(struct mlfq* this, struct proc* p)
 {
-  int dur = sys_uptime() - p->mlfq.start;
+  uint64 dur = rdtsc() - p->mlfq.start;
+  uint64 stridequantum = (uint64)this->metasched.quantum * tscpertick;
+  // Ready deadline process takes the cpu at the next tick.
+  if (edf_preempts(this, p))
+    return 1;
+  // Deadline process runs out its budget.
+  if (p->mlfq.level == -2)
+    return dur >= p->edf.budget;
+  // Thread running on its own share has the stride quantum.
+  if (mycpu()->pinned)
+    return dur >= stridequantum;
   // yield if it use CPU time of RR time quantum.
   return 
     // for stride scheduler
-    (p->mlfq.level == -1 && dur >= this->metasched.quantum)
+    (p->mlfq.level == -1 && dur >= stridequantum)
     // for mlfq scheduler
-    || dur >= this->quantum[p->mlfq.level];
+    || (p->mlfq.level >= 0
+        && dur >= (uint64)this->quantum[p->mlfq.level] * tscpertick);
 }
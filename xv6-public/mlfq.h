@@ -2,17 +2,27 @@
 struct stride {
   uint quantum;               // default time quantum
   uint total;                 // total proportion of stride scheduling process
+  uint maxtotal;              // limit of total
+  float vtime;                // pass value of the last entry picked
   float pass[NPROC];          // pass values, sum of inverse ticket
   uint ticket[NPROC];         // proportion of stride scheduling process
   struct proc* queue[NPROC];  // process queue
+  struct thread* thread[NPROC]; // thread of a thread share, else 0
 };
 
 // MLFQ scheduler context
 struct mlfq {
+  uint nlevel;                        // number of levels in use
   uint quantum[NPROC];                // round robin time quantum
   uint expire[NPROC];                 // time to downgrade level
+  uint boost;                         // period of priority boost
+  uint boostcheck;                    // tick of last mlfq_boost
+  uint boostcursor;                   // next lower level slot to boost
+  uint nlend;                         // levels lent to lock holders
   struct proc* queue[NMLFQ][NPROC];   // process queue
   struct stride metasched;            // meta-scheduler for controlling proportion
+  struct proc* edf[NPROC];            // deadline processes, run before others
+  uint edftotal;                      // (permille) cpu usage of edf
   struct proc** iterstate[NMLFQ];     // iterator state
 };
 
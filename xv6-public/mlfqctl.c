@@ -0,0 +1,87 @@
+/**
+ *  This program prints the scheduler parameters, or sets the ones
+ * given as name and value pairs, for example
+ *   mlfqctl levels 4 quantum 5,10,20,40 expire 20,40,80,200 boost 200
+ * Other names are stride, the stride quantum, and maxstride, the cpu
+ * usage in percent that set_cpu_share may hand out in total.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "mlfqparam.h"
+
+// Parse comma separated numbers into list. Return their count.
+int
+parselist(char *s, uint *list, int max)
+{
+  int n;
+
+  for (n = 0; n < max && *s; ++n) {
+    list[n] = atoi(s);
+    while (*s && *s != ',')
+      ++s;
+    if (*s == ',')
+      ++s;
+  }
+  return n;
+}
+
+void
+printlist(char *name, uint *list, int n)
+{
+  int i;
+
+  printf(1, "%s", name);
+  for (i = 0; i < n; ++i)
+    printf(1, "%c%d", i ? ',' : ' ', list[i]);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct mlfqparam param;
+  int i;
+
+  if (getmlfqparam(&param) < 0) {
+    printf(2, "mlfqctl: getmlfqparam failed\n");
+    exit();
+  }
+  if (argc % 2 == 0) {
+    printf(2, "usage: mlfqctl [name value]...\n");
+    exit();
+  }
+
+  for (i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "levels") == 0)
+      param.nlevel = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "quantum") == 0)
+      parselist(argv[i + 1], param.quantum, NMLFQ);
+    else if (strcmp(argv[i], "expire") == 0)
+      parselist(argv[i + 1], param.expire, NMLFQ);
+    else if (strcmp(argv[i], "boost") == 0)
+      param.boost = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "stride") == 0)
+      param.stridequantum = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "maxstride") == 0)
+      param.maxstride = atoi(argv[i + 1]);
+    else {
+      printf(2, "mlfqctl: unknown parameter %s\n", argv[i]);
+      exit();
+    }
+  }
+  if (argc > 1 && setmlfqparam(&param) < 0) {
+    printf(2, "mlfqctl: parameters out of range\n");
+    exit();
+  }
+
+  getmlfqparam(&param);
+  printf(1, "levels %d\n", param.nlevel);
+  printlist("quantum", param.quantum, param.nlevel);
+  printlist("expire", param.expire, param.nlevel);
+  printf(1, "boost %d\nstride %d\nmaxstride %d\n",
+         param.boost, param.stridequantum, param.maxstride);
+  exit();
+}
@@ -0,0 +1,10 @@
+// Scheduler parameters read by getmlfqparam and set by setmlfqparam.
+// Needs NMLFQ of param.h.
+struct mlfqparam {
+  uint nlevel;              // number of MLFQ levels, at most NMLFQ
+  uint quantum[NMLFQ];      // (ticks) round robin quantum of level
+  uint expire[NMLFQ];       // (ticks) time allotment of level
+  uint boost;               // (ticks) period of priority boost
+  uint stridequantum;       // (ticks) quantum of the stride scheduler
+  uint maxstride;           // (%) cpu usage stride shares may take
+};
@@ -0,0 +1,414 @@
+//
+// Memory-mapped files.
+// Pages of a mapping are read from the file on the first access,
+// see mmapfault() called by trap(). MAP_PRIVATE pages are private
+// copies. MAP_SHARED pages come from a cache of file pages, so all
+// mappings of a file page, in any process, map the same frame; fork
+// shares the loaded ones. The last mapping of a page to go carries
+// it back to the file through the log if any mapping wrote it.
+// Threads of a process share its mapping table, which is guarded by
+// the vma lock of the process, see vmalock().
+//
+// Mapped pages are not coherent with read() and write(): these do
+// not look at the cache, and a page written back replaces the whole
+// page of the file, including bytes written by write() meanwhile.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "rangelock.h"
+#include "file.h"
+#include "fcntl.h"
+
+// Cache of file pages mapped MAP_SHARED. An entry holds a reference
+// to its frame besides the ones of the mappings, see kdup().
+struct mpage {
+  struct inode *ip;   // file, zero if entry is unused
+  uint off;           // file offset of the page
+  char *mem;          // frame
+  int dirty;          // written through a mapping already gone
+};
+
+struct {
+  struct sleeplock lock;
+  struct mpage page[NMPAGE];
+} mcache;
+
+void
+mmapinit(void)
+{
+  initsleeplock(&mcache.lock, "mcache");
+}
+
+// Find mapping containing address va.
+static struct vma*
+vmalookup(struct proc *p, uint va)
+{
+  struct vma *v;
+  for(v = p->vmas; v < &p->vmas[NMMAP]; v++)
+    if(v->f && v->addr <= va && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Find free slot of mapping table.
+static struct vma*
+vmaalloc(struct proc *p)
+{
+  struct vma *v;
+  for(v = p->vmas; v < &p->vmas[NMMAP]; v++)
+    if(v->f == 0)
+      return v;
+  return 0;
+}
+
+// Find lowest free range of len bytes at or above addr.
+// Return 0 if the mapping area has no room.
+static uint
+vmaplace(struct proc *p, uint addr, uint len)
+{
+  struct vma *v;
+
+  if(addr < MMAPBASE)
+    addr = MMAPBASE;
+retry:
+  if(addr + len > MMAPTOP || addr + len < addr)
+    return 0;
+  for(v = p->vmas; v < &p->vmas[NMMAP]; v++){
+    if(v->f && addr < v->addr + v->len && v->addr < addr + len){
+      // Overlapped, retry after the mapping.
+      addr = v->addr + v->len;
+      goto retry;
+    }
+  }
+  return addr;
+}
+
+// Write page mem back to file ip at offset off.
+// Bytes past the end of file are dropped.
+static void
+writeback(struct inode *ip, uint off, char *mem)
+{
+  // Same transaction limit as filewrite.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  int i, n1;
+
+  for(i = 0; i < PGSIZE; i += n1){
+    begin_op();
+    ilock(ip);
+    n1 = 0;
+    if(off + i < ip->size){
+      n1 = PGSIZE - i;
+      if(n1 > max)
+        n1 = max;
+      if(n1 > ip->size - (off + i))
+        n1 = ip->size - (off + i);
+      writei(ip, mem + i, off + i, n1);
+    }
+    iunlock(ip);
+    end_op();
+
+    if(n1 == 0)
+      break;
+  }
+}
+
+// Return the cached page of file ip at offset off, reading it if it
+// is not cached, with a reference for a new mapping. Return 0 if
+// there is no memory or no free entry.
+static char*
+mcacheget(struct inode *ip, uint off)
+{
+  struct mpage *e, *free;
+  char *mem;
+
+  acquiresleep(&mcache.lock);
+  free = 0;
+  for(e = mcache.page; e < &mcache.page[NMPAGE]; e++){
+    if(e->ip == ip && e->off == off){
+      kdup(e->mem);
+      releasesleep(&mcache.lock);
+      return e->mem;
+    }
+    if(e->ip == 0 && free == 0)
+      free = e;
+  }
+  if(free == 0 || (mem = kalloc()) == 0){
+    releasesleep(&mcache.lock);
+    return 0;
+  }
+  // Bytes past the end of file read as zero.
+  memset(mem, 0, PGSIZE);
+  ilock(ip);
+  readi(ip, mem, off, PGSIZE);
+  iunlock(ip);
+  free->ip = ip;
+  free->off = off;
+  free->mem = mem;
+  free->dirty = 0;
+  kdup(mem);
+  releasesleep(&mcache.lock);
+  return mem;
+}
+
+// Drop a mapping of cached page mem, which wrote it if dirty.
+// The last mapping to go writes the page back if any mapping
+// wrote it, and frees it.
+static void
+mcacheput(char *mem, int dirty)
+{
+  struct mpage *e;
+
+  acquiresleep(&mcache.lock);
+  for(e = mcache.page; e < &mcache.page[NMPAGE]; e++)
+    if(e->ip && e->mem == mem)
+      break;
+  if(e == &mcache.page[NMPAGE])
+    panic("mcacheput");
+  e->dirty |= dirty;
+  kfree(mem);
+  if(krefs(mem) == 1){
+    if(e->dirty)
+      writeback(e->ip, e->off, mem);
+    e->ip = 0;
+    kfree(mem);
+  }
+  releasesleep(&mcache.lock);
+}
+
+// Unmap [addr, addr + len) of mapping v from p.
+// Other threads of p may still reach the pages through their
+// TLBs, so they are hidden first and freed after tlbshootdown.
+// Shared pages go back to the cache.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint addr, uint len)
+{
+  uint a;
+  int dirty;
+  char *mem;
+
+  for(a = addr; a < addr + len; a += PGSIZE)
+    hideuvm(p->pgdir, a);
+  tlbshootdown(p);
+  for(a = addr; a < addr + len; a += PGSIZE){
+    if((mem = unmapuvm(p->pgdir, a, &dirty)) == 0)
+      continue;
+    if(v->flags & MAP_SHARED)
+      mcacheput(mem, dirty);
+    else
+      kfree(mem);
+  }
+}
+
+// Map len bytes of file f from offset off into the current process,
+// at addr if that range is free, else at the lowest free address.
+// Return mapped address, or -1 on failure.
+int
+mmap(uint addr, int len, int prot, int flags, struct file *f, int off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  if(len <= 0 || off < 0 || off % PGSIZE != 0 || addr % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if((prot & PROT_READ) == 0 || (prot & ~(PROT_READ|PROT_WRITE)) != 0)
+    return -1;
+  if(f->type != FD_INODE || f->readable == 0)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && f->writable == 0)
+    return -1;
+
+  ilock(f->ip);
+  if(f->ip->type != T_FILE){
+    iunlock(f->ip);
+    return -1;
+  }
+  iunlock(f->ip);
+
+  len = PGROUNDUP(len);
+  acquiresleep(vmalock(p));
+  if((v = vmaalloc(p)) == 0 || (addr = vmaplace(p, addr, len)) == 0){
+    releasesleep(vmalock(p));
+    return -1;
+  }
+
+  v->addr = addr;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = filedup(f);
+  releasesleep(vmalock(p));
+  return addr;
+}
+
+// Unmap [addr, addr + len) which must lie in a single mapping.
+// Return -1 if no mapping contains the range.
+int
+munmap(uint addr, int len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint end;
+
+  if(len <= 0 || addr % PGSIZE != 0)
+    return -1;
+  len = PGROUNDUP(len);
+  acquiresleep(vmalock(p));
+  if((v = vmalookup(p, addr)) == 0 || addr + len > v->addr + v->len){
+    releasesleep(vmalock(p));
+    return -1;
+  }
+
+  // Unmapping the middle splits the mapping in two.
+  end = v->addr + v->len;
+  nv = 0;
+  if(addr > v->addr && addr + len < end && (nv = vmaalloc(p)) == 0){
+    releasesleep(vmalock(p));
+    return -1;
+  }
+
+  vmaunmap(p, v, addr, len);
+
+  if(nv){
+    *nv = *v;
+    nv->addr = addr + len;
+    nv->len = end - nv->addr;
+    nv->off = v->off + (nv->addr - v->addr);
+    filedup(nv->f);
+    v->len = addr - v->addr;
+  } else if(addr == v->addr && addr + len == end){
+    fileclose(v->f);
+    v->f = 0;
+  } else if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+    v->len -= len;
+  } else
+    v->len -= len;
+  releasesleep(vmalock(p));
+  return 0;
+}
+
+// Load page a of mapping v of p from the file, if it is absent.
+// The caller holds the vma lock of p, which also serializes
+// threads faulting on the same page.
+static int
+vmafault(struct proc *p, struct vma *v, uint a)
+{
+  struct inode *ip = v->f->ip;
+  uint off = v->off + (a - v->addr);
+  char *mem;
+  int perm;
+
+  if(uva2ka(p->pgdir, (char*)a) != 0)
+    return 0;
+  if(v->flags & MAP_SHARED){
+    if((mem = mcacheget(ip, off)) == 0)
+      return -1;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    // Bytes past the end of file read as zero.
+    memset(mem, 0, PGSIZE);
+    ilock(ip);
+    readi(ip, mem, off, PGSIZE);
+    iunlock(ip);
+  }
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mapuvm(p->pgdir, a, mem, perm) < 0){
+    if(v->flags & MAP_SHARED)
+      mcacheput(mem, 0);
+    else
+      kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Load page of address va from the mapped file on page fault.
+// Return -1 if va is not mapped or the access is not permitted.
+int
+mmapfault(struct proc *p, uint va, int write)
+{
+  struct vma *v;
+  int r;
+
+  acquiresleep(vmalock(p));
+  if((v = vmalookup(p, va)) == 0 ||
+     (write && (v->prot & PROT_WRITE) == 0)){
+    releasesleep(vmalock(p));
+    return -1;
+  }
+  r = vmafault(p, v, PGROUNDDOWN(va));
+  releasesleep(vmalock(p));
+  return r;
+}
+
+// Copy mappings of p into np, pages already loaded included.
+// Loaded pages of shared mappings are shared with np, others copied.
+// The pages not loaded yet come from the cache on later faults.
+int
+mmapdup(struct proc *np, struct proc *p)
+{
+  int i, r;
+  struct vma *v;
+
+  acquiresleep(vmalock(p));
+  for(i = 0; i < NMMAP; i++){
+    v = &p->vmas[i];
+    if(v->f == 0)
+      continue;
+    if(v->flags & MAP_SHARED)
+      r = shareuvmrange(np->pgdir, p->pgdir, v->addr, v->addr + v->len);
+    else
+      r = copyuvmrange(np->pgdir, p->pgdir, v->addr, v->addr + v->len);
+    if(r < 0){
+      // Drop mappings copied so far, freevm() frees their pages.
+      for(v = np->vmas; v < &np->vmas[NMMAP]; v++){
+        if(v->f){
+          fileclose(v->f);
+          v->f = 0;
+        }
+      }
+      releasesleep(vmalock(p));
+      return -1;
+    }
+    np->vmas[i] = *v;
+    filedup(v->f);
+  }
+  releasesleep(vmalock(p));
+  return 0;
+}
+
+// Unmap every mapping of p from pgdir.
+// Called by exit and exec before the address space is dropped.
+void
+mmapclear(struct proc *p)
+{
+  struct vma *v;
+
+  acquiresleep(vmalock(p));
+  for(v = p->vmas; v < &p->vmas[NMMAP]; v++){
+    if(v->f == 0)
+      continue;
+    vmaunmap(p, v, v->addr, v->len);
+    fileclose(v->f);
+    v->f = 0;
+  }
+  releasesleep(vmalock(p));
+}
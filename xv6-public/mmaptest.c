@@ -0,0 +1,186 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define ASSERT_(x, n, line) if ((x) != (n)) { printf(1, "wrong in line %d\n", line); exit(); }
+
+#define ASSERT(x, n) ASSERT_(x, n, __LINE__)
+
+#define FILENAME "mmapfile"
+#define FILESIZE (3 * 4096 + 100)
+
+char buffer[FILESIZE];
+
+// Create test file filled with a known pattern.
+void mkfile() {
+  int i, fd;
+  for (i = 0; i < FILESIZE; ++i)
+    buffer[i] = i % 251;
+
+  unlink(FILENAME);
+  fd = open(FILENAME, O_CREATE|O_RDWR);
+  ASSERT(write(fd, buffer, FILESIZE), FILESIZE);
+  close(fd);
+}
+
+// Compare file contents with buffer.
+void checkfile(int line) {
+  int i, fd;
+  char c;
+  fd = open(FILENAME, O_RDONLY);
+  for (i = 0; i < FILESIZE; ++i) {
+    ASSERT_(read(fd, &c, 1), 1, line);
+    ASSERT_(c, buffer[i], line);
+  }
+  close(fd);
+}
+
+// case 1. read only private mapping.
+void test_mmap1() {
+  int i, fd;
+  char *p;
+
+  fd = open(FILENAME, O_RDONLY);
+  p = mmap(0, FILESIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  ASSERT(p == MAP_FAILED, 0);
+  close(fd);
+
+  // Mapping survives closing the descriptor.
+  for (i = 0; i < FILESIZE; ++i)
+    ASSERT(p[i], buffer[i]);
+  // Tail of the last page reads as zero.
+  ASSERT(p[FILESIZE], 0);
+
+  ASSERT(munmap(p, FILESIZE), 0);
+  printf(1, "test_mmap1 done\n");
+}
+
+// case 2. shared mapping writes through to the file.
+void test_mmap2() {
+  int fd;
+  char *p;
+
+  fd = open(FILENAME, O_RDWR);
+  p = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  ASSERT(p == MAP_FAILED, 0);
+  close(fd);
+
+  p[0] = buffer[0] = 'a';
+  p[4096] = buffer[4096] = 'b';
+  p[FILESIZE - 1] = buffer[FILESIZE - 1] = 'c';
+  // Beyond end of file, dropped on write back.
+  p[FILESIZE] = 'd';
+
+  ASSERT(munmap(p, FILESIZE), 0);
+  checkfile(__LINE__);
+  printf(1, "test_mmap2 done\n");
+}
+
+// case 3. private mapping does not change the file.
+void test_mmap3() {
+  int fd;
+  char *p;
+
+  fd = open(FILENAME, O_RDWR);
+  p = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ASSERT(p == MAP_FAILED, 0);
+  close(fd);
+
+  p[0] = 'x';
+  p[8192] = 'y';
+  ASSERT(p[0], 'x');
+
+  ASSERT(munmap(p, FILESIZE), 0);
+  checkfile(__LINE__);
+  printf(1, "test_mmap3 done\n");
+}
+
+// case 4. offset mapping, partial unmap and fork.
+void test_mmap4() {
+  int fd, pid;
+  char *p;
+
+  fd = open(FILENAME, O_RDONLY);
+  p = mmap(0, 2 * 4096, PROT_READ, MAP_PRIVATE, fd, 4096);
+  ASSERT(p == MAP_FAILED, 0);
+  // Unaligned offset is rejected.
+  ASSERT(mmap(0, 4096, PROT_READ, MAP_PRIVATE, fd, 100) == MAP_FAILED, 1);
+  // Shared writable mapping needs a writable file.
+  ASSERT(mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) == MAP_FAILED, 1);
+  close(fd);
+
+  ASSERT(p[0], buffer[4096]);
+  ASSERT(munmap(p, 4096), 0);
+  ASSERT(p[4096], buffer[8192]);
+
+  pid = fork();
+  if (pid == 0) {
+    ASSERT(p[4097], buffer[8193]);
+    exit();
+  }
+  ASSERT(pid > 0, 1);
+  wait();
+
+  // Access to unmapped page kills the process.
+  pid = fork();
+  if (pid == 0) {
+    printf(1, "expect a trap of unmapped page: ");
+    printf(1, "%d\n", p[0]);
+    printf(1, "wrong, unmapped page is readable\n");
+    exit();
+  }
+  wait();
+
+  ASSERT(munmap(p + 4096, 4096), 0);
+  printf(1, "test_mmap4 done\n");
+}
+
+// case 5. shared mappings of a file share its pages, across fork
+// and between mappings.
+void test_mmap5() {
+  int fd, pid;
+  char *p, *q;
+
+  fd = open(FILENAME, O_RDWR);
+  p = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  ASSERT(p == MAP_FAILED, 0);
+  q = mmap(0, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  ASSERT(q == MAP_FAILED, 0);
+  close(fd);
+
+  // Page 0 is loaded before fork, page 1 only by the child.
+  ASSERT(p[0], buffer[0]);
+  pid = fork();
+  if (pid == 0) {
+    p[1] = 'e';
+    p[4097] = 'f';
+    exit();
+  }
+  ASSERT(pid > 0, 1);
+  wait();
+  buffer[1] = 'e';
+  buffer[4097] = 'f';
+  ASSERT(p[1], 'e');
+  ASSERT(p[4097], 'f');
+  ASSERT(q[4097], 'f');
+
+  // The last mapping to go writes the pages back.
+  q[2] = buffer[2] = 'g';
+  ASSERT(munmap(p, FILESIZE), 0);
+  ASSERT(munmap(q, FILESIZE), 0);
+  checkfile(__LINE__);
+  printf(1, "test_mmap5 done\n");
+}
+
+int main(int argc, char *argv[]) {
+  mkfile();
+  test_mmap1();
+  test_mmap2();
+  test_mmap3();
+  test_mmap4();
+  test_mmap5();
+  unlink(FILENAME);
+  exit();
+  return 0;
+}
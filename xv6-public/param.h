@@ -3,19 +3,27 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
+#define NMMAP        16  // file mappings per process
+#define NMPAGE      512  // file pages mapped MAP_SHARED at once
 #define NINODE       50  // maximum number of active i-nodes
+#define NRANGE       16  // maximum number of locked ranges per i-node
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       4000  // size of file system in blocks
 
-#define NMLFQ         3  // number of multi-level feedback queue.
+#define NMLFQ         8  // maximum number of multi-level feedback queue.
 #define MAXTICKET   100  // maximum number of ticket.
 #define MAXSTRIDE    80  // maximum number of stride tickets.
+#define MAXEDF       50  // maximum cpu usage of deadline processes (%).
 #define MAXPASS      10000000  // maximum number of pass.
 #define SCALEPASS    100000  // scaling pass.
 
-#define NTHREAD      16  // maximum number of threads.
+#define NTHREAD     256  // maximum number of threads per process
+#define NHASH        64  // buckets of pid and tid hash tables
+#define NUSTACK      32  // cached thread stacks per process
+#define TICKLESS      1  // stop the timer of idle cpus other than cpu 0
+#define NTRACE     1024  // scheduler trace events per cpu
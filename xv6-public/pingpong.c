@@ -0,0 +1,117 @@
+/**
+ *  This program passes a token back and forth between two threads
+ * and reports the ticks taken for the round trips, handing over the
+ * cpu with thread_yield, with yield, and with a condition variable.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NROUND      20000   // default number of round trips
+
+int nround = NROUND;
+volatile int turn;
+volatile int go;
+thread_t peer[2];
+mutex_t lock;
+cond_t changed;
+
+// Hand the cpu straight to the other thread.
+void*
+directmain(void *arg)
+{
+  int me = (int)arg;
+  int i;
+
+  while (!go)
+    yield();
+  for (i = 0; i < nround; ++i) {
+    while (turn != me)
+      thread_yield(peer[1 - me]);
+    turn = 1 - me;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+// Go through the scheduler.
+void*
+yieldmain(void *arg)
+{
+  int me = (int)arg;
+  int i;
+
+  while (!go)
+    yield();
+  for (i = 0; i < nround; ++i) {
+    while (turn != me)
+      yield();
+    turn = 1 - me;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+// Sleep until the other thread signals.
+void*
+condmain(void *arg)
+{
+  int me = (int)arg;
+  int i;
+
+  while (!go)
+    yield();
+  mutex_lock(&lock);
+  for (i = 0; i < nround; ++i) {
+    while (turn != me)
+      cond_wait(&changed, &lock);
+    turn = 1 - me;
+    cond_signal(&changed);
+  }
+  mutex_unlock(&lock);
+  thread_exit(0);
+  return 0;
+}
+
+// Run ping-pong between two threads of fn.
+// Return ticks taken, or -1 on failure.
+int
+run(void*(*fn)(void*))
+{
+  int i, start;
+  void *retval;
+
+  turn = 0;
+  go = 0;
+  mutex_init(&lock);
+  cond_init(&changed);
+  for (i = 0; i < 2; ++i)
+    if (thread_create(&peer[i], fn, (void*)i) != 0)
+      return -1;
+
+  start = uptime();
+  go = 1;
+  for (i = 0; i < 2; ++i)
+    if (thread_join(peer[i], &retval) != 0)
+      return -1;
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc >= 2)
+    nround = atoi(argv[1]);
+
+  // Only a sibling can take the cpu.
+  if (thread_yield(0) != -1 || thread_yield(getpid()) != -1) {
+    printf(1, "pingpong: thread_yield to no sibling succeeded\n");
+    exit();
+  }
+  printf(1, "%d round trips\n", nround);
+  printf(1, "thread_yield: %d ticks\n", run(directmain));
+  printf(1, "yield: %d ticks\n", run(yieldmain));
+  printf(1, "cond: %d ticks\n", run(condmain));
+  exit();
+}
@@ -6,22 +6,35 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "rangelock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define PIPEPAGES     1   // default pipe capacity in pages
+#define PIPEMAXPAGES 16   // maximum pipe capacity in pages
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEMAXPAGES];  // ring buffer pages
+  uint size;      // capacity in bytes, power of two pages
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+// Address of the byte at stream position pos.
+// Its page holds PGSIZE - pos % PGSIZE more contiguous bytes.
+static char*
+pipeaddr(struct pipe *p, uint pos)
+{
+  pos &= p->size - 1;
+  return p->data[pos / PGSIZE] + pos % PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
+  int i;
   struct pipe *p;
 
   p = 0;
@@ -30,6 +43,11 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p->data, 0, sizeof(p->data));
+  p->size = PIPEPAGES * PGSIZE;
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->data[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -47,8 +65,12 @@ pipealloc(struct file **f0, struct file **f1)
 
 //PAGEBREAK: 20
  bad:
-  if(p)
+  if(p){
+    for(i = 0; i < PIPEPAGES; i++)
+      if(p->data[i])
+        kfree(p->data[i]);
     kfree((char*)p);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -59,6 +81,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *p, int writable)
 {
+  int i;
+
   acquire(&p->lock);
   if(writable){
     p->writeopen = 0;
@@ -69,38 +93,53 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
+    for(i = 0; i < p->size / PGSIZE; i++)
+      kfree(p->data[i]);
     kfree((char*)p);
   } else
     release(&p->lock);
 }
 
 //PAGEBREAK: 40
+// Writers copy in bulk and wake readers only when the pipe
+// turns from empty to non-empty, since readers sleep only then.
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m, empty;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(p->nwrite == p->nread + p->size){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    // Copy as much as fits in the current page.
+    m = n - i;
+    if(m > p->size - (p->nwrite - p->nread))
+      m = p->size - (p->nwrite - p->nread);
+    if(m > PGSIZE - p->nwrite % PGSIZE)
+      m = PGSIZE - p->nwrite % PGSIZE;
+
+    empty = p->nread == p->nwrite;
+    memmove(pipeaddr(p, p->nwrite), addr + i, m);
+    p->nwrite += m;
+    if(empty)
+      wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Readers drain everything available up to n bytes and wake
+// writers only when the pipe turns from full to non-full.
 int
 piperead(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m, full;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -110,12 +149,82 @@ piperead(struct pipe *p, char *addr, int n)
     }
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  full = p->nwrite == p->nread + p->size;
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    m = n - i;
+    if(m > p->nwrite - p->nread)
+      m = p->nwrite - p->nread;
+    if(m > PGSIZE - p->nread % PGSIZE)
+      m = PGSIZE - p->nread % PGSIZE;
+
+    memmove(addr + i, pipeaddr(p, p->nread), m);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  if(full && i > 0)
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
+
+// Return capacity of pipe in bytes.
+int
+pipesize(struct pipe *p)
+{
+  return p->size;
+}
+
+// Resize pipe to hold at least n bytes, rounded up to
+// a power of two pages. Buffered data is preserved.
+// Return new capacity, or -1 if n is out of range or
+// smaller than the data currently buffered.
+int
+pipesetsize(struct pipe *p, int n)
+{
+  int i, npages, oldpages;
+  uint size, pos;
+  char *tmp, *data[PIPEMAXPAGES];
+
+  if(n <= 0 || n > PIPEMAXPAGES * PGSIZE)
+    return -1;
+  for(size = PGSIZE; size < n; size <<= 1)
+    ;
+
+  // Allocate new ring before taking the lock.
+  npages = size / PGSIZE;
+  memset(data, 0, sizeof(data));
+  for(i = 0; i < npages; i++){
+    if((data[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(data[i]);
+      return -1;
+    }
+  }
+
+  acquire(&p->lock);
+  if(p->nwrite - p->nread > size){
+    release(&p->lock);
+    for(i = 0; i < npages; i++)
+      kfree(data[i]);
+    return -1;
+  }
+
+  // Stream positions are kept, so bytes only move between rings.
+  for(pos = p->nread; pos != p->nwrite; pos++)
+    data[(pos & (size - 1)) / PGSIZE][pos % PGSIZE] = *pipeaddr(p, pos);
+
+  oldpages = p->size / PGSIZE;
+  for(i = 0; i < PIPEMAXPAGES; i++){
+    tmp = p->data[i];
+    p->data[i] = data[i];
+    data[i] = tmp;
+  }
+  p->size = size;
+
+  // Writers may have been waiting on the old capacity.
+  wakeup(&p->nwrite);
+  release(&p->lock);
+
+  for(i = 0; i < oldpages; i++)
+    kfree(data[i]);
+  return size;
+}
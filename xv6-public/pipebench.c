@@ -0,0 +1,71 @@
+/**
+ *  This program measures pipe throughput between two processes
+ * for each pipe capacity configurable with fcntl(F_SETPIPE_SZ).
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define TOTAL       (1024 * 1024)   // (bytes) per measurement
+#define CHUNK       8192            // (bytes) per read/write call
+
+char buf[CHUNK];
+
+// Send TOTAL bytes through a pipe of given capacity
+// and return elapsed ticks.
+int
+run(int capacity)
+{
+  int fds[2], pid, n, total, start;
+
+  if (pipe(fds) < 0) {
+    printf(1, "pipebench: pipe failed\n");
+    exit();
+  }
+  if (fcntl(fds[1], F_SETPIPE_SZ, capacity) != capacity) {
+    printf(1, "pipebench: cannot set capacity %d\n", capacity);
+    exit();
+  }
+
+  start = uptime();
+  if ((pid = fork()) < 0) {
+    printf(1, "pipebench: fork failed\n");
+    exit();
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    for (total = 0; total < TOTAL; total += CHUNK)
+      if (write(fds[1], buf, CHUNK) != CHUNK) {
+        printf(1, "pipebench: write failed\n");
+        exit();
+      }
+    exit();
+  }
+
+  close(fds[1]);
+  total = 0;
+  while ((n = read(fds[0], buf, CHUNK)) > 0)
+    total += n;
+  close(fds[0]);
+  wait();
+
+  if (total != TOTAL) {
+    printf(1, "pipebench: expected %d bytes, got %d\n", TOTAL, total);
+    exit();
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int capacity, ticks;
+
+  for (capacity = 4096; capacity <= 64 * 1024; capacity *= 2) {
+    ticks = run(capacity);
+    printf(1, "capacity %d: %d ticks per MB\n", capacity, ticks);
+  }
+  exit();
+}
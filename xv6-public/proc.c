@@ -5,14 +5,25 @@
 #include "mlfq.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "slab.h"
+#include "thread.h"
+#include "rusage.h"
+#include "trace.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct spinlock tlock[NPROC];  // run queue and thread list of proc
+  struct sleeplock vlock[NPROC]; // file mappings of proc
 } ptable;
 
+// Thread lock of process p. Nests inside ptable.lock.
+#define THREADLOCK(p) (&ptable.tlock[(p) - ptable.proc])
+
 struct mlfq mlfq;
 
 static struct proc *initproc;
@@ -24,13 +35,358 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+// Thread control blocks, a free one keeps its kernel stack.
+static struct slab threadslab;
+
+// Sleeping threads by channel, chained on collision.
+// Protected by ptable.lock.
+static struct thread *sleephash[NHASH];
+#define SLEEPHASH(chan) (((uint)(chan) >> 2) % NHASH)
+
+// Processes by pid and threads by tid, chained on collision.
+// Protected by ptable.lock.
+static struct proc *pidhash[NHASH];
+static struct thread *tidhash[NHASH];
+
+static void
+pidinsert(struct proc *p)
+{
+  p->hnext = pidhash[p->pid % NHASH];
+  pidhash[p->pid % NHASH] = p;
+}
+
+static void
+pidremove(struct proc *p)
+{
+  struct proc **pp;
+
+  for (pp = &pidhash[p->pid % NHASH]; *pp; pp = &(*pp)->hnext)
+    if (*pp == p) {
+      *pp = p->hnext;
+      break;
+    }
+}
+
+static struct proc*
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  if (pid <= 0)
+    return 0;
+  for (p = pidhash[pid % NHASH]; p; p = p->hnext)
+    if (p->pid == pid)
+      return p;
+  return 0;
+}
+
+static void
+tidinsert(struct proc *p, struct thread *t)
+{
+  t->proc = p;
+  t->joiner = 0;
+  t->hnext = tidhash[t->tid % NHASH];
+  tidhash[t->tid % NHASH] = t;
+}
+
+// Unlink t and give up its tid.
+static void
+tidremove(struct thread *t)
+{
+  struct thread **pt;
+
+  if (t->tid == 0)
+    return;
+  for (pt = &tidhash[t->tid % NHASH]; *pt; pt = &(*pt)->hnext)
+    if (*pt == t) {
+      *pt = t->hnext;
+      break;
+    }
+  t->tid = 0;
+}
+
+static int
+kstackdrop(void *v)
+{
+  struct thread *t = v;
+
+  if(t->kstack == 0)
+    return 0;
+  kfree(t->kstack);
+  t->kstack = 0;
+  return 1;
+}
+
+// Free kernel stacks cached in free thread blocks.
+// Return number of freed stacks.
+static int
+kstackreclaim(void)
+{
+  return slabdrain(&threadslab, kstackdrop);
+}
+
+static struct thread*
+tidlookup(int tid)
+{
+  struct thread *t;
+
+  if (tid <= 0)
+    return 0;
+  for (t = tidhash[tid % NHASH]; t; t = t->hnext)
+    if (t->tid == tid)
+      return t;
+  return 0;
+}
+
+// Append t to the run queue of p and make it runnable.
+// The thread lock of p must be held.
+static void
+runqpush(struct proc *p, struct thread *t)
+{
+  t->state = RUNNABLE;
+  t->rnext = 0;
+  if (p->runq == 0)
+    p->runq = t;
+  else
+    p->runqtail->rnext = t;
+  p->runqtail = t;
+}
+
+// Remove runnable t from the run queue of p and make it running.
+// The thread lock of p must be held.
+static void
+runqtake(struct proc *p, struct thread *t)
+{
+  struct thread *prev, *iter;
+
+  prev = 0;
+  for (iter = p->runq; iter != t; iter = iter->rnext)
+    prev = iter;
+  if (prev)
+    prev->rnext = t->rnext;
+  else
+    p->runq = t->rnext;
+  if (p->runqtail == t)
+    p->runqtail = prev;
+  t->state = RUNNING;
+}
+
+// Make t runnable and wake up a halted cpu to run it.
+static void
+setrunnable(struct thread *t)
+{
+  struct proc *p = t->proc;
+
+  acquire(THREADLOCK(p));
+  runqpush(p, t);
+  release(THREADLOCK(p));
+  trace(TRACE_WAKEUP, p->pid, t->tid, 0);
+  cpukick(t);
+}
+
+// First thread of the run queue of p that may run on cpu c,
+// preferring one that last ran there, or 0 if there is none.
+// Works without the thread lock as a hint, so it walks
+// no more threads than p has.
+struct thread*
+runqfirst(struct proc *p, struct cpu *c)
+{
+  struct thread *t, *first;
+  int n;
+
+  first = 0;
+  for (t = p->runq, n = 0; t && n < p->nthread; t = t->rnext, ++n) {
+    if (!cpuallowed(t, c))
+      continue;
+    if (&cpus[t->lastcpu] == c)
+      return t;
+    if (first == 0)
+      first = t;
+  }
+  return first;
+}
+
+// Take runnable thread t of p, or the first one that may run on this
+// cpu if t is 0, and make it running. Return 0 if it is not runnable.
+struct thread*
+runqpop(struct proc *p, struct thread *t)
+{
+  acquire(THREADLOCK(p));
+  if (t == 0)
+    t = runqfirst(p, mycpu());
+  if (t && t->state == RUNNABLE && cpuallowed(t, mycpu()))
+    runqtake(p, t);
+  else
+    t = 0;
+  release(THREADLOCK(p));
+  return t;
+}
+
+// Return 1 if no thread of p runs or waits to run.
+static int
+procblocked(struct proc *p)
+{
+  struct thread *t;
+
+  if (p->runq)
+    return 0;
+  for (t = p->threads; t; t = t->next)
+    if (t->state == RUNNING)
+      return 0;
+  return 1;
+}
+
+// Wake up t if it is sleeping. The ptable lock must be held.
+static void
+wakethread(struct thread *t)
+{
+  if (t->state != SLEEPING)
+    return;
+  *t->sprev = t->snext;
+  if (t->snext)
+    t->snext->sprev = t->sprev;
+  // Sleep of a blocked process earns it priority.
+  if (procblocked(t->proc))
+    mlfq_wake(&mlfq, t->proc, rdtsc() - t->sleepstart);
+  // Thread share does not catch up on its sleep either.
+  if (t->share.index)
+    stride_wake(&mlfq.metasched, t->share.index);
+  setrunnable(t);
+}
+
+// Allocate a thread of p, with a kernel stack set up to return
+// to user space through forkret and trapret, and link it to p.
+// The ptable lock must be held.
+static struct thread*
+threadalloc(struct proc *p)
+{
+  struct thread *t;
+  char *sp;
+
+  if ((t = slaballoc(&threadslab)) == 0)
+    return 0;
+  // Take back idle kernel stacks if memory is short.
+  if (t->kstack == 0 && (t->kstack = kalloc()) == 0 &&
+      (kstackreclaim() == 0 || (t->kstack = kalloc()) == 0)) {
+    slabfree(&threadslab, t);
+    return 0;
+  }
+  sp = t->kstack + KSTACKSIZE;
+
+  // Leave room for trap frame.
+  sp -= sizeof *t->tf;
+  t->tf = (struct trapframe*)sp;
+
+  // Set up new context to start executing at forkret,
+  // which returns to trapret.
+  sp -= 4;
+  *(uint*)sp = (uint)trapret;
+
+  sp -= sizeof *t->context;
+  t->context = (struct context*)sp;
+  memset(t->context, 0, sizeof *t->context);
+  t->context->eip = (uint)forkret;
+
+  t->state = EMBRYO;
+  t->tid = nexttid++;
+  t->chan = 0;
+  t->retval = 0;
+  t->tls = 0;
+  t->tlssize = 0;
+  t->ustack = 0;
+  t->resumable = 0;
+  t->share.index = 0;
+  t->runtime = 0;
+  t->affinity = p->affinity;
+  t->lastcpu = 0;
+  tidinsert(p, t);
+
+  acquire(THREADLOCK(p));
+  t->next = p->threads;
+  if (t->next)
+    t->next->prev = &t->next;
+  t->prev = &p->threads;
+  p->threads = t;
+  p->nthread++;
+  release(THREADLOCK(p));
+  return t;
+}
+
+// Unlink t from its process and free it.
+// The ptable lock must be held.
+static void
+threadfree(struct thread *t)
+{
+  struct proc *p = t->proc;
+
+  ustackfree(p, t);
+  if (t->share.index)
+    mlfq_thread_unshare(&mlfq, p, t);
+  p->runtime += t->runtime;
+  tidremove(t);
+  acquire(THREADLOCK(p));
+  *t->prev = t->next;
+  if (t->next)
+    t->next->prev = t->prev;
+  p->nthread--;
+  release(THREADLOCK(p));
+  t->state = UNUSED;
+  t->proc = 0;
+  slabfree(&threadslab, t);
+}
+
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NPROC; i++){
+    initlock(&ptable.tlock[i], "thread");
+    initsleeplock(&ptable.vlock[i], "vma");
+  }
+  slabinit(&threadslab, "thread", sizeof(struct thread));
+  ustackinit();
   mlfq_init(&mlfq);
 }
 
+// Free pages chained through their first word.
+static void
+freepages(char *list)
+{
+  char *mem;
+
+  while((mem = list) != 0){
+    list = *(char**)mem;
+    kfree(mem);
+  }
+}
+
+// Free the stack pages ustackevict took from p, once no cpu
+// reaches them through its TLB. Called without ptable.lock.
+static void
+reapstacks(struct proc *p)
+{
+  char *list;
+
+  acquire(&ptable.lock);
+  list = p->stale;
+  p->stale = 0;
+  release(&ptable.lock);
+  if(list){
+    tlbshootdown(p);
+    freepages(list);
+  }
+}
+
+// Lock of the file mappings of p. It is a sleep lock,
+// page faults on mappings read the file under it.
+struct sleeplock*
+vmalock(struct proc *p)
+{
+  return &ptable.vlock[p - ptable.proc];
+}
+
 // Must be called with interrupts disabled
 int
 cpuid() {
@@ -57,6 +413,75 @@ mycpu(void)
   panic("unknown apicid\n");
 }
 
+// Wake up one cpu halted in the scheduler that may run queued t,
+// the one t last ran on if it is idle.
+// The cpu announces itself idle before it looks for work, and the
+// queueing comes before the look at the announcements here, so one
+// side always sees the other. If the idle cpu is this one, interrupted
+// before it halts, clearing the announcement is enough.
+void
+cpukick(struct thread *t)
+{
+  struct cpu *c, *me;
+  int i;
+
+  // Order the queueing before the reads of c->idle.
+  __sync_synchronize();
+  pushcli();
+  me = mycpu();
+  for (i = -1; i < ncpu; ++i) {
+    c = &cpus[i < 0 ? t->lastcpu : i];
+    if (!cpuallowed(t, c))
+      continue;
+    if (c->idle && xchg(&c->idle, 0)) {
+      if (c != me)
+        lapicipi(c->apicid, T_IRQ0 + IRQ_WAKE);
+      break;
+    }
+  }
+  popcli();
+}
+
+// Flush translations of the page table of p on every cpu running
+// p, before the pages it lost are freed. lcr3 alone only flushes
+// this cpu. Under ptable.lock a cpu leaving p has switched to the
+// kernel page table and one entering p loads the changed one, so
+// only cpus with c->proc == p are asked. Waits for them to answer,
+// so the caller holds no spinlock.
+void
+tlbshootdown(struct proc *p)
+{
+  struct cpu *c;
+  uint seen[NCPU], mask;
+  int i;
+
+  mask = 0;
+  acquire(&ptable.lock);
+  for (i = 0; i < ncpu; ++i) {
+    c = &cpus[i];
+    if (c->proc != p)
+      continue;
+    if (c == mycpu()) {
+      lcr3(V2P(p->pgdir));
+      continue;
+    }
+    seen[i] = c->tlbflushes;
+    mask |= 1 << i;
+    lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+  }
+  release(&ptable.lock);
+  for (i = 0; i < ncpu; ++i)
+    while ((mask & (1 << i)) && cpus[i].tlbflushes == seen[i])
+      ;
+}
+
+// Check whether t may run on cpu c.
+int
+cpuallowed(struct thread *t, struct cpu *c)
+{
+  return (t->affinity >> (c - cpus)) & 1;
+}
+
 // Disable interrupts so that we are not rescheduled
 // while reading proc from the cpu structure
 struct proc*
@@ -70,6 +495,19 @@ myproc(void) {
   return p;
 }
 
+// Disable interrupts so that we are not rescheduled
+// while reading thread from the cpu structure
+struct thread*
+mythread(void) {
+  struct cpu *c;
+  struct thread *t;
+  pushcli();
+  c = mycpu();
+  t = c->thread;
+  popcli();
+  return t;
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -79,9 +517,7 @@ static struct proc*
 allocproc(void)
 {
   struct proc *p;
-  struct thread* t;
-  char *sp;
-  int off;
+  struct thread *t;
 
   acquire(&ptable.lock);
 
@@ -95,46 +531,31 @@ allocproc(void)
 found:
   // Set default process, thread states.
   p->state = EMBRYO;
+  p->threads = 0;
+  p->nthread = 0;
+  p->runq = 0;
+  p->runqtail = 0;
+  p->exiting = 0;
+  p->ustacks = 0;
+  p->stale = 0;
+  p->runtime = 0;
+  p->affinity = ~0;
+  if((t = threadalloc(p)) == 0){
+    p->state = UNUSED;
+    release(&ptable.lock);
+    return 0;
+  }
   p->pid = nextpid++;
-  p->tidx = 0;
-
-  t = p->threads;
-  t->state = EMBRYO;
-  t->tid = nexttid++;
+  pidinsert(p);
 
   // Add process to MLFQ scheulder.
+  p->mlfq.credit = 0;
+  p->edf.misses = 0;
   mlfq_append(&mlfq, p, 0);
   release(&ptable.lock);
 
-  // Reset stacks.
-  for (off = 0; off < NTHREAD; ++off) {
-    p->kstacks[off] = 0;
-    p->ustacks[off] = 0;
-  }
-
-  // Allocate kernel stack.
-  if((p->kstacks[0] = kalloc()) == 0){
-    p->state = UNUSED;
-    t->state = UNUSED;
-    return 0;
-  }
-  t->kstack = p->kstacks[0];
-  sp = t->kstack + KSTACKSIZE;
-
-  // Leave room for trap frame.
-  sp -= sizeof *t->tf;
-  t->tf = (struct trapframe*)sp;
-
-  // Set up new context to start executing at forkret,
-  // which returns to trapret.
-  sp -= 4;
-  *(uint*)sp = (uint)trapret;
-
-  sp -= sizeof *t->context;
-  t->context = (struct context*)sp;
-  memset(t->context, 0, sizeof *t->context);
-  t->context->eip = (uint)forkret;
-
+  // Reset file mappings.
+  memset(p->vmas, 0, sizeof(p->vmas));
   return p;
 }
 
@@ -175,7 +596,7 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
-  t->state = RUNNABLE;
+  setrunnable(t);
 
   release(&ptable.lock);
 }
@@ -189,6 +610,9 @@ growproc(int n)
   struct proc *curproc = myproc();
 
   sz = curproc->sz;
+  // Heap must not run into the file mapping area.
+  if(n > 0 && sz + n > MMAPBASE)
+    return -1;
   if(n > 0){
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -207,43 +631,58 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid, tmp;
+  int i, pid, r;
   struct proc *np;
   struct proc *curproc = myproc();
+  struct thread *curthread = mythread();
+  struct thread *nt;
 
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
-
-  // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->threads->kstack);
-    np->threads->kstack = 0;
-    np->threads->state = UNUSED;
-    np->kstacks[0] = 0;
+  nt = np->threads;
+
+  // Copy process state from proc. Siblings may change
+  // the stacks meanwhile, so copy them under ptable.lock.
+  r = -1;
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) != 0){
+    acquire(&ptable.lock);
+    r = ustackdup(np, curproc, curthread, nt);
+    release(&ptable.lock);
+  }
+  if(r < 0 || mmapdup(np, curproc) < 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
+    np->pgdir = 0;
+    acquire(&ptable.lock);
+    ustackclear(np);
+    threadfree(nt);
+    // np never ran, no TLB holds its pages.
+    freepages(np->stale);
+    np->stale = 0;
+    pidremove(np);
+    mlfq_delete(&mlfq, np);
+    np->pid = 0;
     np->state = UNUSED;
+    release(&ptable.lock);
     return -1;
   }
 
   np->sz = curproc->sz;
   np->parent = curproc;
 
-  np->tidx = 0;
-  // Copy user stack pool.
-  for (i = 0; i < NTHREAD; ++i)
-    np->ustacks[i] = curproc->ustacks[i];
-
-  // Swap stacks of current thread index and index 0.
-  tmp = np->ustacks[0];
-  np->ustacks[0] = np->ustacks[curproc->tidx];
-  np->ustacks[curproc->tidx] = tmp;
+  // Forking thread keeps its thread-local storage.
+  nt->tls = curthread->tls;
+  nt->tlssize = curthread->tlssize;
+  np->affinity = curproc->affinity;
+  nt->affinity = curthread->affinity;
 
   // Copy trapframe, it will return to instruction `retn` of fork syscall.
-  *np->threads->tf = *curproc->threads[curproc->tidx].tf;
+  *nt->tf = *curthread->tf;
 
   // Clear %eax so that fork returns 0 in the child.
-  np->threads->tf->eax = 0;
+  nt->tf->eax = 0;
 
   for(i = 0; i < NOFILE; i++)
     if(curproc->ofile[i])
@@ -257,7 +696,7 @@ fork(void)
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
-  np->threads->state = RUNNABLE;
+  setrunnable(nt);
 
   release(&ptable.lock);
 
@@ -271,13 +710,26 @@ void
 exit(void)
 {
   struct proc *curproc = myproc();
+  struct thread *curthread = mythread();
   struct proc *p;
-  struct thread *t;
   int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
+  // Only one thread tears the process down,
+  // the others leave when it asks them to.
+  if(killothers() < 0){
+    acquire(&ptable.lock);
+    curthread->state = ZOMBIE;
+    wakeup1(&curproc->exiting);
+    sched();
+    panic("zombie exit");
+  }
+
+  // Write back and drop file mappings.
+  mmapclear(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -307,9 +759,7 @@ exit(void)
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
-  for (t = curproc->threads; t < &curproc->threads[NTHREAD]; t++)
-    if (t->state != UNUSED)
-      t->state = ZOMBIE;
+  curthread->state = ZOMBIE;
 
   sched();
   panic("zombie exit");
@@ -321,8 +771,7 @@ int
 wait(void)
 {
   struct proc *p;
-  struct thread *t;
-  int havekids, pid, off;
+  int havekids, pid;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
@@ -336,19 +785,15 @@ wait(void)
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        // Free all zombie threads.
-        for (t = p->threads; t < &p->threads[NTHREAD]; t++) {
-          off = t - p->threads;
-          if (p->kstacks[off] != 0) {
-            kfree(p->kstacks[off]);
-            p->kstacks[off] = 0;
-            p->ustacks[off] = 0;
-          }
-          t->kstack = 0;
-          t->state = UNUSED;
-          t->tid = 0;
-        }
+        // Free the zombie thread, freevm frees the user stacks.
+        ustackclear(p);
+        while (p->threads)
+          threadfree(p->threads);
+        // No cpu runs p anymore, none reaches its pages.
+        freepages(p->stale);
+        p->stale = 0;
         freevm(p->pgdir);
+        pidremove(p);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -397,7 +842,6 @@ void
 sched(void)
 {
   int intena;
-  struct proc *p = myproc();
   struct thread *t;
 
   if(!holding(&ptable.lock))
@@ -405,7 +849,7 @@ sched(void)
   if(mycpu()->ncli != 1)
     panic("sched locks");
 
-  t = &p->threads[p->tidx];
+  t = mythread();
   if(t->state == RUNNING)
     panic("sched running");
   if(readeflags()&FL_IF)
@@ -415,57 +859,122 @@ sched(void)
   mycpu()->intena = intena;
 }
 
-// Context switching between threads.
-// It do not reload the cr3 but update only address of kernel stack
-// for previlege escalation.
-void
-next_thread(struct proc* p) {
+// Switch from the current thread to runnable sibling next, or to
+// the head of the run queue if next is 0. Called with the thread
+// lock of p held, returns with it released.
+// A thread suspended here releases the lock its resumer hands over
+// in cpu->handoff. So if next was suspended here as well, the switch
+// takes only the thread lock and neither ptable.lock nor the
+// scheduler is involved. Threads suspended in sched() and new ones
+// expect ptable.lock, so switching to them takes it first.
+// Return -1 if there is no thread to switch to.
+static int
+threadswitch(struct proc *p, struct thread *next)
+{
   int intena;
-  struct thread* iter;
-  struct thread* t = &p->threads[p->tidx];
-  acquire(&ptable.lock);
+  uint64 now;
+  struct thread *cur = mythread();
+
+  if (next == 0)
+    next = runqfirst(p, mycpu());
+  if (next == 0 || next == cur || next->state != RUNNABLE ||
+      !cpuallowed(next, mycpu())) {
+    release(THREADLOCK(p));
+    return -1;
+  }
 
-  // Find runnable thread.
-  for (iter = t + 1; ; ++iter) {
-    if (iter == &p->threads[NTHREAD])
-      iter = p->threads;
-    if (iter == t) {
-      // If runnable thread does not exist and
-      // current thread is also not runnable.
-      if (t->state != RUNNING) {
-        sched();
-        panic("next_thread cannot run thread");
-      }
-      break;
+  if (next->resumable) {
+    runqtake(p, next);
+    runqpush(p, cur);
+    cur->resumable = 1;
+    mycpu()->handoff = THREADLOCK(p);
+  } else {
+    release(THREADLOCK(p));
+    acquire(&ptable.lock);
+    acquire(THREADLOCK(p));
+    // next may have been taken meanwhile.
+    if (next->proc != p || next->state != RUNNABLE) {
+      release(THREADLOCK(p));
+      release(&ptable.lock);
+      return -1;
     }
+    runqtake(p, next);
+    runqpush(p, cur);
+    release(THREADLOCK(p));
+    mycpu()->handoff = &ptable.lock;
+  }
+  if(mycpu()->ncli != 1)
+    panic("threadswitch locks");
+
+  // Charge cur for its time on the cpu.
+  now = rdtsc();
+  cur->runtime += now - mycpu()->tscstart;
+  trace(TRACE_SWITCHOUT, p->pid, cur->tid,
+        (int)(now - mycpu()->tscstart));
+  trace(TRACE_SWITCHIN, p->pid, next->tid, p->mlfq.level);
+  mycpu()->tscstart = now;
+
+  // Same address space, only the kernel stack and TLS change.
+  // Time left goes to next, not to a cpu share of cur.
+  mycpu()->thread = next;
+  mycpu()->pinned = 0;
+  next->lastcpu = cpuid();
+  switch_trap_kstack(p);
+
+  // Context switch.
+  intena = mycpu()->intena;
+  swtch(&cur->context, next->context);
+  mycpu()->intena = intena;
+
+  cur->resumable = 0;
+  release(mycpu()->handoff);
+  return 0;
+}
 
-    // If runnable thread found.
-    if (iter->state == RUNNABLE) {
-      t->state = RUNNABLE;
-      iter->state = RUNNING;
+// Context switching between threads on timer interrupts.
+// It do not reload the cr3 but update only address of kernel stack
+// for previlege escalation.
+void
+next_thread(struct proc* p) {
+  // Thread running on its own share keeps the cpu.
+  if (mycpu()->pinned)
+    return;
+  acquire(THREADLOCK(p));
+  threadswitch(p, 0);
+}
 
-      // Update running thread index.
-      p->tidx = iter - p->threads;
-      switch_trap_kstack(p);
+// Give the cpu to sibling thread tid if it is runnable.
+// Return -1 if it is not.
+int
+thread_yield(int tid)
+{
+  struct proc *p = myproc();
+  struct thread *t;
 
-      // Context switch.
-      intena = mycpu()->intena;
-      swtch(&t->context, iter->context);
-      mycpu()->intena = intena;
+  acquire(THREADLOCK(p));
+  for (t = p->threads; t; t = t->next)
+    if (t->tid == tid)
       break;
-    }
+  // Not a sibling, so no switch to whoever comes first.
+  if (t == 0) {
+    release(THREADLOCK(p));
+    return -1;
   }
-  release(&ptable.lock);
+  return threadswitch(p, t);
 }
 
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
-  struct proc *p;
+  struct thread *t;
+
   acquire(&ptable.lock);  //DOC: yieldlock
-  p = myproc();
-  p->threads[p->tidx].state = RUNNABLE;
+  // This cpu goes on to the scheduler anyway, so do not kick another.
+  t = mythread();
+  acquire(THREADLOCK(t->proc));
+  runqpush(t->proc, t);
+  release(THREADLOCK(t->proc));
   sched();
   release(&ptable.lock);
 }
@@ -516,9 +1025,15 @@ sleep(void *chan, struct spinlock *lk)
     release(lk);
   }
   // Go to sleep.
-  t = &p->threads[p->tidx];
+  t = mythread();
   t->chan = chan;
   t->state = SLEEPING;
+  t->sleepstart = rdtsc();
+  t->snext = sleephash[SLEEPHASH(chan)];
+  if (t->snext)
+    t->snext->sprev = &t->snext;
+  t->sprev = &sleephash[SLEEPHASH(chan)];
+  *t->sprev = t;
 
   sched();
 
@@ -533,19 +1048,31 @@ sleep(void *chan, struct spinlock *lk)
 }
 
 //PAGEBREAK!
+// Wake up at most n threads sleeping on chan.
+// The ptable lock must be held. Return number of woken threads.
+static int
+wakeupn(void *chan, int n)
+{
+  struct thread *t, *next;
+  int woken;
+
+  woken = 0;
+  for (t = sleephash[SLEEPHASH(chan)]; t && woken < n; t = next) {
+    next = t->snext;
+    if (t->chan == chan) {
+      wakethread(t);
+      woken++;
+    }
+  }
+  return woken;
+}
+
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
-  struct thread *t;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == RUNNABLE)
-      for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-        if (t->state == SLEEPING && t->chan == chan)
-          t->state = RUNNABLE;
+  wakeupn(chan, NTHREAD * NPROC);
 }
 
 // Wake up all processes sleeping on chan.
@@ -557,6 +1084,58 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Kernel address of the user word at uaddr, or 0 if it is
+// misaligned or not mapped. Waiters on the same word sleep on
+// the same channel whichever thread computed it.
+static int*
+futexaddr(int *uaddr)
+{
+  char *page;
+
+  if ((uint)uaddr % sizeof(int) != 0)
+    return 0;
+  if ((page = uva2ka(myproc()->pgdir, (char*)uaddr)) == 0)
+    return 0;
+  return (int*)(page + ((uint)uaddr & (PGSIZE - 1)));
+}
+
+// Sleep until futex_wake on uaddr, if *uaddr still equals val.
+// Checking the word under ptable.lock means a wake issued after
+// the user changed the word cannot be lost.
+// Return 0 if woken up, -1 if the word did not match.
+int
+futex_wait(int *uaddr, int val)
+{
+  int *kaddr;
+
+  acquire(&ptable.lock);
+  if ((kaddr = futexaddr(uaddr)) == 0 || *kaddr != val ||
+      myproc()->killed) {
+    release(&ptable.lock);
+    return -1;
+  }
+  sleep(kaddr, &ptable.lock);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake up at most n threads waiting on uaddr.
+// Return number of woken threads.
+int
+futex_wake(int *uaddr, int n)
+{
+  int *kaddr;
+
+  acquire(&ptable.lock);
+  if ((kaddr = futexaddr(uaddr)) == 0) {
+    release(&ptable.lock);
+    return -1;
+  }
+  n = wakeupn(kaddr, n);
+  release(&ptable.lock);
+  return n;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -567,17 +1146,14 @@ kill(int pid)
   struct thread *t;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      for (t = p->threads; t < &p->threads[NTHREAD]; t++)
-        // Wake process from sleep if necessary.
-        if (t->state == SLEEPING)
-          t->state = RUNNABLE;
+  if((p = pidlookup(pid)) != 0){
+    p->killed |= KILL_PROC;
+    // Wake process from sleep if necessary.
+    for (t = p->threads; t; t = t->next)
+      wakethread(t);
 
-      release(&ptable.lock);
-      return 0;
-    }
+    release(&ptable.lock);
+    return 0;
   }
   release(&ptable.lock);
   return -1;
@@ -604,22 +1180,24 @@ procdump(void)
   char *state;
   uint pc[10];
 
+  cprintf("levels lent to sleep lock holders: %d\n", mlfq.nlend);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->state == UNUSED)
       continue;
-    
-    t = &p->threads[p->tidx];
-    if(t->state >= 0 && t->state < NELEM(states) && states[t->state])
-      state = states[t->state];
-    else
-      state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
-    if(t->state == SLEEPING){
-      getcallerpcs((uint*)t->context->ebp+2, pc);
-      for(i=0; i<10 && pc[i] != 0; i++)
-        cprintf(" %p", pc[i]);
+
+    for(t = p->threads; t; t = t->next){
+      if(t->state >= 0 && t->state < NELEM(states) && states[t->state])
+        state = states[t->state];
+      else
+        state = "???";
+      cprintf("%d %d %s %s", p->pid, t->tid, state, p->name);
+      if(t->state == SLEEPING){
+        getcallerpcs((uint*)t->context->ebp+2, pc);
+        for(i=0; i<10 && pc[i] != 0; i++)
+          cprintf(" %p", pc[i]);
+      }
+      cprintf("\n");
     }
-    cprintf("\n");
   }
 }
 
@@ -642,6 +1220,147 @@ set_cpu_share(int percent)
   return mlfq_cpu_share(&mlfq, myproc(), percent);
 }
 
+// Move process to the deadline scheduling class with runtime ticks
+// of cpu every period ticks, or back to MLFQ if runtime is 0.
+int
+sched_deadline(int runtime, int period)
+{
+  int r;
+
+  if (runtime < 0 || period <= 0)
+    return -1;
+  acquire(&ptable.lock);
+  r = mlfq_deadline(&mlfq, myproc(), runtime, period);
+  release(&ptable.lock);
+  return r;
+}
+
+// Let the threads of process id, or thread -id, or the calling thread
+// if id is 0, run only on the cpus in mask. New threads of a process
+// take the mask of the process. Return -1 if there is no such
+// process or thread, or mask has no cpu.
+int
+sched_setaffinity(int id, uint mask)
+{
+  struct proc *p;
+  struct thread *t;
+
+  mask &= (1 << ncpu) - 1;
+  if (mask == 0)
+    return -1;
+
+  acquire(&ptable.lock);
+  if (id > 0) {
+    if ((p = pidlookup(id)) == 0) {
+      release(&ptable.lock);
+      return -1;
+    }
+    p->affinity = mask;
+    for (t = p->threads; t; t = t->next) {
+      t->affinity = mask;
+      // The cpus it may run on now may be halted.
+      if (t->state == RUNNABLE)
+        cpukick(t);
+    }
+  } else {
+    t = id == 0 ? mythread() : tidlookup(-id);
+    if (t == 0) {
+      release(&ptable.lock);
+      return -1;
+    }
+    t->affinity = mask;
+    if (t->state == RUNNABLE)
+      cpukick(t);
+  }
+
+  // Move away from a cpu that is no longer allowed,
+  // waking one that is.
+  t = mythread();
+  if (!cpuallowed(t, mycpu())) {
+    acquire(THREADLOCK(t->proc));
+    runqpush(t->proc, t);
+    release(THREADLOCK(t->proc));
+    cpukick(t);
+    sched();
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Lift process pid, which holds a sleep lock the current process
+// waits for, to the MLFQ level of the current process.
+void
+sleeplockboost(int pid)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  if((p = pidlookup(pid)) != 0 && p != myproc())
+    mlfq_lend(&mlfq, p, myproc());
+  release(&ptable.lock);
+}
+
+// Read the parameters of the scheduler.
+void
+getmlfqparam(struct mlfqparam *param)
+{
+  acquire(&ptable.lock);
+  mlfq_getparam(&mlfq, param);
+  release(&ptable.lock);
+}
+
+// Set the parameters of the scheduler at once.
+int
+setmlfqparam(struct mlfqparam *param)
+{
+  int r;
+
+  acquire(&ptable.lock);
+  r = mlfq_setparam(&mlfq, param);
+  release(&ptable.lock);
+  return r;
+}
+
+// Fill ru with cpu time of the current process and thread.
+// Siblings running on other cpus are charged up to their last switch.
+void
+getrusage(struct rusage *ru)
+{
+  struct proc *p = myproc();
+  struct thread *t;
+  uint64 cur;
+
+  acquire(&ptable.lock);
+  // Current run is not charged yet.
+  cur = rdtsc() - mycpu()->tscstart;
+  ru->threadtime = mythread()->runtime + cur;
+  ru->cputime = p->runtime + cur;
+  for (t = p->threads; t; t = t->next)
+    ru->cputime += t->runtime;
+  ru->tscpertick = tscpertick;
+  ru->misses = p->edf.misses;
+  release(&ptable.lock);
+}
+
+// Give thread tid of the current process its own share of cpu,
+// or drop its share if percent is 0.
+int
+set_thread_share(int tid, int percent)
+{
+  struct proc *p = myproc();
+  struct thread *t;
+  int r;
+
+  acquire(&ptable.lock);
+  if ((t = tidlookup(tid)) == 0 || t->proc != p) {
+    release(&ptable.lock);
+    return -1;
+  }
+  r = mlfq_thread_share(&mlfq, p, t, percent);
+  release(&ptable.lock);
+  return r;
+}
+
 // End of thread, make thread state zombie
 // and update user thread.
 void
@@ -652,84 +1371,71 @@ thread_epilogue(void) {
   acquire(&ptable.lock);
 
   p = myproc();
-  t = &p->threads[p->tidx];
+  t = mythread();
 
-  // Update thread state.
+  // Update thread state, wake the joiner without scanning ptable.
   t->state = ZOMBIE;
-  wakeup1((void*)t->tid);
+  if (t->joiner && t->joiner->chan == t)
+    wakethread(t->joiner);
+
+  // The thread tearing down the process waits for the others.
+  if (p->exiting)
+    wakeup1(&p->exiting);
 
   sched();
   panic("thread_epilogue: unreachable statements");
 }
 
-// Create thread with given user thread structure
-// and start routine.
+// Create thread with given user thread structure, attributes
+// and start routine. attr may be null for the defaults.
 int
-thread_create(int *tid, void*(*start_routine)(void*), void *arg) {
-  int tidx, sz;
+thread_create(int *tid, struct thread_attr *attr,
+              void*(*start_routine)(void*), void *arg) {
+  uint sz, stacksize, guardsize;
   char *sp;
   struct proc *p;
   struct thread *t;
 
+  stacksize = PGSIZE;
+  guardsize = 0;
+  if (attr) {
+    if (attr->stacksize)
+      stacksize = PGROUNDUP(attr->stacksize);
+    guardsize = PGROUNDUP(attr->guardsize);
+    if (attr->tlssize > MAXTLS || stacksize + guardsize < stacksize)
+      return -1;
+  }
+
   acquire(&ptable.lock);
 
-  // Find unused thread slot.
+  // No new threads while the process is going away.
   p = myproc();
-  for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-    if (t->state == UNUSED)
-      goto find;
-  
-  release(&ptable.lock);
-  return -1;
-
-find:
-  tidx = t - p->threads;
-  t->tid = nexttid++;
-
-  // Allocate new kernel stack for isolating space.
-  if (p->kstacks[tidx] == 0 && (p->kstacks[tidx] = kalloc()) == 0) {
-    t->tid = 0;
-    t->state = UNUSED;
+  if (p->killed || p->nthread >= NTHREAD || (t = threadalloc(p)) == 0) {
     release(&ptable.lock);
     return -1;
   }
-  // Assign allocated stack.
-  t->kstack = p->kstacks[tidx];
-  sp = t->kstack + KSTACKSIZE;
 
   // Copy trapframe for recovering trivial bytes
   // (segment registers, etc..)
-  sp -= sizeof *t->tf;
-  t->tf = (struct trapframe*)sp;
-  *t->tf = *p->threads[p->tidx].tf;
+  *t->tf = *mythread()->tf;
 
-  // Second return address is trapret.
-  sp -= 4;
-  *(uint*)sp = (uint)trapret;
-
-  // Clear context.
-  sp -= sizeof *t->context;
-  t->context = (struct context*)sp;
-  memset(t->context, 0, sizeof *t->context);
-
-  // First return address is forkret.
-  t->context->eip = (uint)forkret;
+  // Allocate user stack in the stack region.
+  if ((sz = ustackalloc(p, t, stacksize + guardsize, guardsize)) == 0) {
+    threadfree(t);
+    release(&ptable.lock);
+    reapstacks(p);
+    return -1;
+  }
 
-  // Allocate user stack.
-  if (p->ustacks[tidx] != 0)
-    sz = p->ustacks[tidx];
-  else {
-    sz = PGROUNDUP(p->sz);
-    if ((sz = allocuvm(p->pgdir, sz, sz + PGSIZE)) == 0) {
-      t->kstack = 0;
-      t->tid = 0;
-      t->state = UNUSED;
-      release(&ptable.lock);
-      return -1;
-    }
-    
-    p->sz = sz;
-    p->ustacks[tidx] = sz;
+  // Thread-local storage is addressed through %gs.
+  if (attr && attr->tlssize) {
+    t->tls = (uint)attr->tls;
+    t->tlssize = attr->tlssize;
+    t->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+  } else {
+    t->tls = 0;
+    t->tlssize = 0;
+    t->tf->gs = 0;
   }
 
   // Write argument for start routine.
@@ -751,57 +1457,104 @@ find:
   // Initialize user thread structure.
   *tid = t->tid;
 
-  t->retval = 0;
-  t->state = RUNNABLE;
+  setrunnable(t);
   release(&ptable.lock);
+  reapstacks(p);
   return 0;
 }
 
 // Exit thread, write return value and run epilogue of thread.
 void
 thread_exit(void *retval) {
-  struct proc *p = myproc();
-  p->threads[p->tidx].retval = retval;
+  mythread()->retval = retval;
   thread_epilogue();
 }
 
 // Wait until thread is done.
 // It acts like `wait` on exit process.
 // It clean up the exit thread and write the return value.
+// Only a thread of the same process may join, one at a time.
 int
 thread_join(int tid, void **retval) {
-  struct proc* p;
+  struct proc* p = myproc();
   struct thread* t;
+  struct thread* cur;
 
   acquire(&ptable.lock);
-  // Searching given thread ID.
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; ++p)
-    if (p->state == RUNNABLE)
-      for (t = p->threads; t < &p->threads[NTHREAD]; ++t)
-        if (t->tid == tid)
-          goto found;    
-
-  release(&ptable.lock);
-  return -1;
-
-found:
-  // Wait until target thread is done.
-  do {
-    if (t->state == ZOMBIE)
-      break;
+  cur = mythread();
+  if ((t = tidlookup(tid)) == 0 || t->proc != p || t == cur ||
+      t->joiner != 0) {
+    release(&ptable.lock);
+    return -1;
+  }
 
-    sleep((void*)tid, &ptable.lock);
-  } while (0);
+  // Wait until target thread is done, thread_epilogue wakes us.
+  t->joiner = cur;
+  while (t->state != ZOMBIE) {
+    if (p->killed) {
+      t->joiner = 0;
+      release(&ptable.lock);
+      return -1;
+    }
+    sleep(t, &ptable.lock);
+    // killothers may have freed t meanwhile. Tids are not reused,
+    // so finding it again means it is still the same thread.
+    if ((t = tidlookup(tid)) == 0 || t->proc != p || t->joiner != cur) {
+      release(&ptable.lock);
+      return -1;
+    }
+  }
 
   // Write return value.
   *retval = t->retval;
 
-  // Free exit thread.
-  t->kstack = 0;
-  t->state = UNUSED;
-  t->tid = 0;
-  t->retval = 0;
+  // Free exit thread, its stacks are kept for the next one.
+  threadfree(t);
+
+  release(&ptable.lock);
+  reapstacks(p);
+  return 0;
+}
 
+// Make the other threads of the current process exit and free
+// them, waiting for those still running. Used by exit and exec.
+// Return -1 if another thread is already doing so.
+int
+killothers(void)
+{
+  struct proc *p = myproc();
+  struct thread *cur = mythread();
+  struct thread *t, *next;
+  int alive;
+
+  acquire(&ptable.lock);
+  if (p->exiting) {
+    release(&ptable.lock);
+    return -1;
+  }
+  p->exiting = cur;
+  p->killed |= KILL_OTHERS;
+  for (;;) {
+    alive = 0;
+    for (t = p->threads; t; t = next) {
+      next = t->next;
+      if (t == cur)
+        continue;
+      if (t->state == ZOMBIE) {
+        threadfree(t);
+      } else {
+        // Sleeping ones see p->killed once woken up.
+        wakethread(t);
+        alive = 1;
+      }
+    }
+    if (!alive)
+      break;
+    sleep(&p->exiting, &ptable.lock);
+  }
+  p->killed &= ~KILL_OTHERS;
+  p->exiting = 0;
   release(&ptable.lock);
+  reapstacks(p);
   return 0;
 }
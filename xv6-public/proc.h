@@ -8,6 +8,12 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct thread *thread;       // The thread running on this cpu or null
+  struct spinlock *handoff;    // Released by a thread resumed in threadswitch
+  int pinned;                  // Running thread runs on its own cpu share
+  uint64 tscstart;             // Time-stamp counter when thread got the cpu
+  volatile uint idle;          // Looking for work or halted, see cpukick
+  volatile uint tlbflushes;    // TLB flushes asked by other cpus
 };
 
 extern struct cpu cpus[NCPU];
@@ -43,6 +49,45 @@ struct thread {
   struct trapframe *tf;         // trap frame for current interrupt handler.
   struct context *context;      // cpu context, swtch() here to run process
   void* retval;                 // return value
+  uint tls;                     // base of TLS segment, loaded into %gs
+  uint tlssize;                 // size of TLS segment, zero if none
+  struct proc *proc;            // owner process
+  struct thread *hnext;         // next thread of tid hash chain
+  struct thread *joiner;        // thread waiting in thread_join, if any
+  struct thread *next;          // next thread of process
+  struct thread **prev;         // link pointing to this thread
+  struct thread *rnext;         // next thread of run queue
+  struct thread *snext;         // next thread of sleep queue
+  struct thread **sprev;        // link pointing to this thread
+  struct ustack *ustack;        // user stack, zero if in heap
+  int resumable;                // suspended in threadswitch, see proc.c
+  uint64 runtime;               // (cycles) time spent running
+  uint64 sleepstart;            // (tsc) when it went to sleep
+  uint affinity;                // mask of cpus it may run on
+  int lastcpu;                  // cpu it ran on last
+  struct {
+    int index;                  // entry of stride scheduler, 0 if none
+    int inproc;                 // share taken from the process share
+  } share;                      // own cpu share, see set_thread_share
+};
+
+// File mapping
+struct vma {
+  uint addr;                    // first mapped address, page aligned
+  uint len;                     // length in bytes, page aligned
+  int prot;                     // PROT_READ, PROT_WRITE
+  int flags;                    // MAP_SHARED or MAP_PRIVATE
+  struct file *f;               // mapped file, zero if slot is unused
+  uint off;                     // file offset of addr
+};
+
+// Thread user stack in the stack region
+struct ustack {
+  uint base;                    // lowest address, guard included
+  uint size;                    // bytes, guard included
+  uint guard;                   // bytes of guard at base
+  struct thread *owner;         // owner thread, zero if cached for reuse
+  struct ustack *next;          // next stack, in descending address order
 };
 
 // Per-process state
@@ -52,26 +97,52 @@ struct proc {
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
-  int killed;                  // If non-zero, have been killed
+  int killed;                  // If non-zero, have been killed, see KILL_*
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct proc *hnext;          // next process of pid hash chain
+  struct vma vmas[NMMAP];      // File mappings
 
-  int tidx;                         // index of running thread
-  struct thread threads[NTHREAD];   // thread pool
-  char* kstacks[NTHREAD];           // kernel stack pool
-  uint ustacks[NTHREAD];            // user stack pool
+  struct thread *threads;           // list of threads
+  int nthread;                      // length of threads
+  struct thread *runq;              // runnable threads, first to run first
+  struct thread *runqtail;          // last of runq
+  struct thread *exiting;           // thread terminating the others
+  struct ustack *ustacks;           // user stacks of threads
+  char *stale;                      // evicted stack pages, see reapstacks
+  uint64 runtime;                   // (cycles) run time of freed threads
+  uint affinity;                    // cpu mask of new threads
 
   struct {
-    int level;                // scheduler level, -1 for stride, 0 ~ 3 for MLFQ
+    int level;                // scheduler level, -2 for deadline,
+                              // -1 for stride, 0 ~ nlevel-1 for MLFQ
     int index;                // index of process table in scheduler
-    uint elapsed;             // cpu time spent by process
-    uint start;               // start tick.
+    uint64 elapsed;           // (cycles) cpu time spent in the level
+    uint64 start;             // (tsc) start of the current run
+    uint since;               // (ticks) entry into the level
+    uint64 credit;            // (cycles) sleep not yet promoted for
   } mlfq;                     // member for MLFQ scheduler
+
+  struct {
+    uint runtime;             // (ticks) cpu time granted every period
+    uint period;              // (ticks)
+    uint usage;               // (permille) runtime of period
+    uint deadline;            // (ticks) end of the current period
+    uint64 budget;            // (cycles) runtime left in the period
+    uint misses;              // periods ended with budget left unused
+    uint ready;               // (ticks) last wakeup or preemption
+  } edf;                      // member for deadline scheduling, level -2
 };
 
+// Bits of proc.killed
+#define KILL_PROC   1   // whole process exits
+#define KILL_OTHERS 2   // threads other than p->exiting exit
+
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// followed by file mappings from MMAPBASE and thread stacks
+// from STACKBASE, see mmap.c and ustack.c.
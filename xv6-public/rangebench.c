@@ -0,0 +1,112 @@
+/**
+ *  This program measures positional I/O from several threads on one
+ * file. Each thread preads and pwrites its own region, so with range
+ * locking the threads should not wait on each other. The shared mode
+ * points every thread at the first region for comparison.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define FILENAME    "rangebench.dat"
+#define MAXTHREAD   4
+#define REGION      16384   // (bytes) region per thread
+#define CHUNK       512     // (bytes) per call
+#define NOP         400     // default calls per thread
+
+int fd;
+int nop = NOP;
+int shared;
+int failed;
+
+// Write then read back chunks of the region of thread arg.
+void*
+worker(void *arg)
+{
+  int id = (int)arg;
+  int i, j, off, base;
+  char buf[CHUNK], out[CHUNK];
+
+  base = shared ? 0 : id * REGION;
+  for (i = 0; i < nop; ++i) {
+    off = base + (i * CHUNK) % REGION;
+    for (j = 0; j < CHUNK; ++j)
+      buf[j] = id + i + j;
+    if (pwrite(fd, buf, CHUNK, off) != CHUNK ||
+        pread(fd, out, CHUNK, off) != CHUNK) {
+      failed = 1;
+      break;
+    }
+    // Other threads write the shared region as well.
+    for (j = 0; !shared && j < CHUNK; ++j) {
+      if (buf[j] != out[j]) {
+        failed = 1;
+        thread_exit(0);
+      }
+    }
+  }
+  thread_exit(0);
+  return 0;
+}
+
+// Run n threads and return elapsed ticks.
+int
+run(int n)
+{
+  int i, start;
+  void *ret;
+  thread_t tid[MAXTHREAD];
+
+  start = uptime();
+  for (i = 0; i < n; ++i) {
+    if (thread_create(&tid[i], worker, (void*)i) < 0) {
+      printf(1, "rangebench: thread_create failed\n");
+      exit();
+    }
+  }
+  for (i = 0; i < n; ++i)
+    thread_join(tid[i], &ret);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+  char buf[CHUNK];
+
+  if (argc >= 2)
+    nop = atoi(argv[1]);
+
+  // Allocate every region up front, so pwrites do not extend the file.
+  if ((fd = open(FILENAME, O_CREATE|O_RDWR)) < 0) {
+    printf(1, "rangebench: cannot create %s\n", FILENAME);
+    exit();
+  }
+  memset(buf, 0, CHUNK);
+  for (i = 0; i < MAXTHREAD * REGION; i += CHUNK) {
+    if (write(fd, buf, CHUNK) != CHUNK) {
+      printf(1, "rangebench: cannot fill %s\n", FILENAME);
+      exit();
+    }
+  }
+
+  for (shared = 0; shared < 2; ++shared) {
+    for (n = 1; n <= MAXTHREAD; n *= 2) {
+      failed = 0;
+      i = run(n);
+      if (failed) {
+        printf(1, "rangebench: %d threads failed\n", n);
+        exit();
+      }
+      printf(1, "%s regions, %d threads: %d calls in %d ticks\n",
+             shared ? "shared" : "private", n, 2 * n * nop, i);
+    }
+  }
+
+  close(fd);
+  unlink(FILENAME);
+  exit();
+}
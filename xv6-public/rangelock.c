@@ -0,0 +1,71 @@
+// Byte-range locks
+// Several processes may hold non-overlapping ranges of the same
+// inode at once, and shared ranges may overlap each other.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "rangelock.h"
+
+void
+initrangelock(struct rangelock *rl, char *name)
+{
+  struct range *r;
+
+  initlock(&rl->lk, "range lock");
+  rl->name = name;
+  for(r = rl->r; r < &rl->r[NRANGE]; r++)
+    r->mode = 0;
+}
+
+// Check whether [start, end) in mode conflicts with a held range.
+// Return a free slot if it does not, otherwise zero.
+static struct range*
+rangefree(struct rangelock *rl, uint start, uint end, int mode)
+{
+  struct range *r, *free;
+
+  free = 0;
+  for(r = rl->r; r < &rl->r[NRANGE]; r++){
+    if(r->mode == 0){
+      if(free == 0)
+        free = r;
+      continue;
+    }
+    if(start < r->end && r->start < end &&
+       (mode == RANGE_EXCL || r->mode == RANGE_EXCL))
+      return 0;
+  }
+  return free;
+}
+
+// Lock bytes [start, end), sleeping while they conflict with
+// a range held by someone else. Return handle for releaserange.
+struct range*
+acquirerange(struct rangelock *rl, uint start, uint end, int mode)
+{
+  struct range *r;
+
+  acquire(&rl->lk);
+  while((r = rangefree(rl, start, end, mode)) == 0)
+    sleep(rl, &rl->lk);
+  r->start = start;
+  r->end = end;
+  r->mode = mode;
+  release(&rl->lk);
+  return r;
+}
+
+void
+releaserange(struct rangelock *rl, struct range *r)
+{
+  acquire(&rl->lk);
+  r->mode = 0;
+  wakeup(rl);
+  release(&rl->lk);
+}
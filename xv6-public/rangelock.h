@@ -0,0 +1,17 @@
+// Byte-range locks for positional I/O on an inode
+struct range {
+  uint start;        // First locked byte
+  uint end;          // One past the last locked byte
+  int mode;          // RANGE_SHARED, RANGE_EXCL or 0 if slot is unused
+};
+
+struct rangelock {
+  struct spinlock lk;         // spinlock protecting ranges
+  struct range r[NRANGE];     // locked ranges
+
+  // For debugging:
+  char *name;                 // Name of lock.
+};
+
+#define RANGE_SHARED  1  // readers may overlap
+#define RANGE_EXCL    2  // no other range may overlap
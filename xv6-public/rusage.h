@@ -0,0 +1,7 @@
+// Cpu time reported by getrusage, measured with the time-stamp counter.
+struct rusage {
+  uint64 cputime;       // (cycles) run time of all threads of the process
+  uint64 threadtime;    // (cycles) run time of the calling thread
+  uint tscpertick;      // (cycles) measured length of a timer tick
+  uint misses;          // deadlines missed in the deadline class
+};
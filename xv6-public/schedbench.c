@@ -0,0 +1,417 @@
+/**
+ *  This program benchmarks the scheduler with a mix of workers and
+ * prints the results as key=value lines, one per line. The mix is
+ * given as name and value pairs, for example
+ *   schedbench cpu 2 io 1 yield 1 threads 2 stride 20,10 ticks 300
+ * cpu and yield workers spin, the latter yielding between work units,
+ * io workers sleep until a waker process writes to their pipe every
+ * tick, threads spins in that many threads of one process and stride
+ * starts one worker per share given to set_cpu_share. After the mix
+ * it measures the cost of a switch between two processes and between
+ * two threads pinned to cpu 0.
+ *
+ * Shares are measured against the cpu time of all workers, so the mix
+ * should keep every cpu busy. cpu time, shares and share errors are in
+ * permille. Latencies and switch costs are in cycles, tscpertick
+ * converts them to ticks.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "param.h"
+#include "rusage.h"
+
+#define NSTRIDE       8         // stride workers at most
+#define NSAMPLE       1024      // latency samples kept by an io worker
+#define NROUND        1000      // round trips of a switch measurement
+#define COUNT_PERIOD  10000     // (iteration) one unit of work
+
+enum { CPU, IO, YIELD, THREADS, STRIDE, NKIND };
+
+char *kindname[NKIND] = { "cpu", "io", "yield", "threads", "stride" };
+
+// Report of a worker to the parent.
+struct result {
+  int kind;
+  int idx;
+  int failed;
+  uint work;              // (units) work done in the run
+  uint64 cputime;         // (cycles) cpu time of the worker
+  int nlat;               // latency samples taken
+  uint lat[4];            // (cycles) p50, p90, p99 and max latency
+};
+
+int nworker[NKIND] = { 2, 1, 1, 0, 2 };
+uint share[NSTRIDE] = { 20, 10 };
+int nthread;
+uint runticks = 300;
+uint start, end;          // (ticks) the run of the mix
+
+uint samples[NSAMPLE];
+uint threadwork[NPROC];
+
+// Parse comma separated numbers into list. Return their count.
+int
+parselist(char *s, uint *list, int max)
+{
+  int n;
+
+  for (n = 0; n < max && *s; ++n) {
+    list[n] = atoi(s);
+    while (*s && *s != ',')
+      ++s;
+    if (*s == ',')
+      ++s;
+  }
+  return n;
+}
+
+// part / total in permille.
+uint
+permille(uint64 part, uint64 total)
+{
+  while (total >> 32) {
+    part >>= 1;
+    total >>= 1;
+  }
+  if (total == 0)
+    return 0;
+  return (uint)udiv64(part * 1000, (uint)total);
+}
+
+void
+print(char *kind, int idx, char *key, int value)
+{
+  if (idx < 0)
+    printf(1, "%s.%s=%d\n", kind, key, value);
+  else
+    printf(1, "%s.%d.%s=%d\n", kind, idx, key, value);
+}
+
+// Spin until the end of the run, yielding between units if asked.
+uint
+spin(int yielding)
+{
+  uint i, work;
+
+  while (readticks() < start)
+    ;
+  work = 0;
+  for (i = 0; readticks() < end; ++i) {
+    // Prevent code optimization
+    __sync_synchronize();
+    if (i == COUNT_PERIOD) {
+      work++;
+      i = 0;
+      if (yielding)
+        yield();
+    }
+  }
+  return work;
+}
+
+void*
+threadmain(void *arg)
+{
+  threadwork[(int)arg] = spin(0);
+  thread_exit(0);
+  return 0;
+}
+
+// Sort list in place. The lists are short enough for insertion sort.
+void
+sort(uint *list, int n)
+{
+  int i, j;
+  uint v;
+
+  for (i = 1; i < n; ++i) {
+    v = list[i];
+    for (j = i; j > 0 && list[j - 1] > v; --j)
+      list[j] = list[j - 1];
+    list[j] = v;
+  }
+}
+
+// Wake the io worker at the other end of fd every tick.
+void
+waker(int fd)
+{
+  uint64 now;
+
+  while (readticks() < start)
+    sleep(1);
+  while (readticks() < end) {
+    sleep(1);
+    now = rdtsc();
+    write(fd, &now, sizeof(now));
+  }
+  close(fd);
+}
+
+// Wait for the waker, take the latency from its write to this read,
+// then do a little work.
+void
+ioworker(struct result *r)
+{
+  int fd[2], n, i;
+  uint64 sent;
+
+  if (pipe(fd) < 0) {
+    r->failed = 1;
+    return;
+  }
+  if (fork() == 0) {
+    close(fd[0]);
+    waker(fd[1]);
+    exit();
+  }
+  close(fd[1]);
+  n = 0;
+  while (read(fd[0], &sent, sizeof(sent)) == sizeof(sent)) {
+    if (n < NSAMPLE)
+      samples[n++] = (uint)(rdtsc() - sent);
+    for (i = 0; i < COUNT_PERIOD; ++i)
+      __sync_synchronize();
+    r->work++;
+  }
+  close(fd[0]);
+  wait();
+
+  sort(samples, n);
+  r->nlat = n;
+  if (n > 0) {
+    r->lat[0] = samples[n * 50 / 100];
+    r->lat[1] = samples[n * 90 / 100];
+    r->lat[2] = samples[n * 99 / 100];
+    r->lat[3] = samples[n - 1];
+  }
+}
+
+void
+worker(struct result *r)
+{
+  struct rusage ru;
+  thread_t threads[NPROC];
+  void *retval;
+  int i;
+
+  switch (r->kind) {
+  case CPU:
+    r->work = spin(0);
+    break;
+  case YIELD:
+    r->work = spin(1);
+    break;
+  case STRIDE:
+    if (set_cpu_share(share[r->idx]) < 0) {
+      r->failed = 1;
+      break;
+    }
+    r->work = spin(0);
+    break;
+  case THREADS:
+    for (i = 0; i < nthread; ++i) {
+      if (thread_create(&threads[i], threadmain, (void*)i) != 0)
+        break;
+    }
+    if (i < nthread)
+      r->failed = 1;
+    while (--i >= 0) {
+      thread_join(threads[i], &retval);
+      r->work += threadwork[i];
+    }
+    break;
+  case IO:
+    ioworker(r);
+    break;
+  }
+  getrusage(&ru);
+  r->cputime = ru.cputime;
+}
+
+void
+runmix(void)
+{
+  struct result r, res[NPROC];
+  int fd[2], kind, i, n, nres;
+  uint64 total;
+  uint work, got, maxerr;
+  int err;
+
+  if (pipe(fd) < 0) {
+    printf(1, "schedbench: pipe failed\n");
+    exit();
+  }
+  start = uptime() + 2;
+  end = start + runticks;
+  n = 0;
+  for (kind = 0; kind < NKIND; ++kind) {
+    for (i = 0; i < nworker[kind]; ++i, ++n) {
+      if (fork() == 0) {
+        close(fd[0]);
+        memset(&r, 0, sizeof(r));
+        r.kind = kind;
+        r.idx = i;
+        worker(&r);
+        write(fd[1], &r, sizeof(r));
+        exit();
+      }
+    }
+  }
+  close(fd[1]);
+  for (nres = 0; nres < n && nres < NPROC; ++nres)
+    if (read(fd[0], &res[nres], sizeof(res[nres])) != sizeof(res[nres]))
+      break;
+  close(fd[0]);
+  for (i = 0; i < n; ++i)
+    wait();
+
+  total = 0;
+  work = 0;
+  for (i = 0; i < nres; ++i) {
+    total += res[i].cputime;
+    work += res[i].work;
+  }
+  maxerr = 0;
+  for (i = 0; i < nres; ++i) {
+    r = res[i];
+    print(kindname[r.kind], r.idx, "failed", r.failed);
+    print(kindname[r.kind], r.idx, "work", r.work);
+    got = permille(r.cputime, total);
+    print(kindname[r.kind], r.idx, "cpu", got);
+    if (r.kind == STRIDE) {
+      err = got - share[r.idx] * 10;
+      print(kindname[r.kind], r.idx, "share", share[r.idx] * 10);
+      print(kindname[r.kind], r.idx, "error", err);
+      if (err < 0)
+        err = -err;
+      if (err > maxerr)
+        maxerr = err;
+    }
+    if (r.kind == IO) {
+      print(kindname[r.kind], r.idx, "samples", r.nlat);
+      print(kindname[r.kind], r.idx, "p50", r.lat[0]);
+      print(kindname[r.kind], r.idx, "p90", r.lat[1]);
+      print(kindname[r.kind], r.idx, "p99", r.lat[2]);
+      print(kindname[r.kind], r.idx, "max", r.lat[3]);
+    }
+  }
+  print("mix", -1, "workers", nres);
+  print("mix", -1, "ticks", runticks);
+  print("mix", -1, "throughput", work / runticks);
+  print("mix", -1, "maxerror", maxerr);
+}
+
+// Bounce a byte NROUND times between the ends of two pipes.
+void
+pingpong(int in, int out, int first)
+{
+  int i;
+  char c;
+
+  c = 0;
+  for (i = 0; i < NROUND; ++i) {
+    if (first)
+      write(out, &c, 1);
+    read(in, &c, 1);
+    if (!first)
+      write(out, &c, 1);
+  }
+}
+
+int ping[2], pong[2];
+
+void*
+ponger(void *arg)
+{
+  sched_setaffinity(0, 1);
+  pingpong(pong[0], ping[1], 0);
+  thread_exit(0);
+  return 0;
+}
+
+// Return the cycles of one switch between two processes, or two
+// threads of this process, pinned to cpu 0.
+uint
+switchcost(int threaded)
+{
+  thread_t t;
+  void *retval;
+  uint64 begin, elapsed;
+
+  if (pipe(ping) < 0 || pipe(pong) < 0) {
+    printf(1, "schedbench: pipe failed\n");
+    exit();
+  }
+  sched_setaffinity(0, 1);
+  if (threaded) {
+    if (thread_create(&t, ponger, 0) != 0) {
+      printf(1, "schedbench: thread_create failed\n");
+      exit();
+    }
+  } else if (fork() == 0) {
+    sched_setaffinity(0, 1);
+    pingpong(pong[0], ping[1], 0);
+    exit();
+  }
+  begin = rdtsc();
+  pingpong(ping[0], pong[1], 1);
+  elapsed = rdtsc() - begin;
+  if (threaded)
+    thread_join(t, &retval);
+  else
+    wait();
+  sched_setaffinity(0, ~0);
+
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  // Every round trip switches twice.
+  return (uint)udiv64(elapsed, 2 * NROUND);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage ru;
+  int i;
+
+  if (argc % 2 == 0) {
+    printf(2, "usage: schedbench [name value]...\n");
+    exit();
+  }
+  for (i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "cpu") == 0)
+      nworker[CPU] = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "io") == 0)
+      nworker[IO] = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "yield") == 0)
+      nworker[YIELD] = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "threads") == 0)
+      nthread = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "stride") == 0)
+      nworker[STRIDE] = parselist(argv[i + 1], share, NSTRIDE);
+    else if (strcmp(argv[i], "ticks") == 0)
+      runticks = atoi(argv[i + 1]);
+    else {
+      printf(2, "schedbench: unknown parameter %s\n", argv[i]);
+      exit();
+    }
+  }
+  nworker[THREADS] = nthread > 0;
+  if (nthread > NPROC || runticks == 0) {
+    printf(2, "schedbench: parameters out of range\n");
+    exit();
+  }
+
+  getrusage(&ru);
+  print("bench", -1, "tscpertick", ru.tscpertick);
+  runmix();
+  print("switch", -1, "proc", switchcost(0));
+  print("switch", -1, "thread", switchcost(1));
+  exit();
+}
@@ -0,0 +1,233 @@
+/**
+ *  This program reads the scheduler trace for given ticks, 100 by
+ * default. For every process it prints the runs, demotions, promotions
+ * on wakeup, lifts for holding a contended sleep lock and cpu time,
+ * with histograms of the latency from wakeup to getting the cpu and of
+ * the length of runs. For every cpu it prints the context switches and
+ * the share of time spent in the scheduler. Run it next to a load, for
+ * example `cputime &; schedtrace 200`, to tune the MLFQ quanta and
+ * expiries.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+#include "rusage.h"
+#include "trace.h"
+
+#define NBATCH      256     // events read at once
+#define NPSTAT      32      // processes summarized
+#define NWAKE       256     // pending wakeups remembered
+#define NBUCKET     10      // histogram buckets
+#define BUCKETUNIT  64      // first bucket is 1/BUCKETUNIT of a tick
+
+struct pstat {
+  int pid;
+  int nrun;
+  int ndemote;
+  int npromote;             // woke up a level higher
+  int nlend;                // lifted while holding a sleep lock
+  uint64 runtime;           // (cycles)
+  uint latency[NBUCKET];    // wakeup to switch in
+  uint runlen[NBUCKET];     // switch in to switch out
+};
+
+struct wake {
+  int tid;
+  uint64 tsc;
+};
+
+// Time from a switch out to the next switch in on a cpu
+// is the scheduler overhead, unless the cpu went idle.
+struct cpustat {
+  int nswitch;
+  uint64 lastout;           // (tsc) last switch out, 0 if idle since
+  uint64 overhead;          // (cycles)
+};
+
+struct traceevent batch[NBATCH];
+struct cpustat cpustats[NCPU];
+struct pstat pstats[NPSTAT];
+struct wake wakes[NWAKE];
+uint tscpertick;
+int nboost, nlost, nmiss;
+
+// Bucket b > 0 holds [2^(b-1), 2^b) units, the last one the rest.
+int
+bucket(uint64 cycles)
+{
+  uint units;
+  int b;
+
+  units = udiv64(cycles * BUCKETUNIT, tscpertick);
+  for (b = 0; units > 0 && b < NBUCKET - 1; ++b)
+    units >>= 1;
+  return b;
+}
+
+struct pstat*
+findpstat(int pid)
+{
+  struct pstat *s;
+
+  for (s = pstats; s < &pstats[NPSTAT]; ++s) {
+    if (s->pid == pid)
+      return s;
+    if (s->pid == 0) {
+      s->pid = pid;
+      return s;
+    }
+  }
+  return 0;
+}
+
+// Order the events of a batch by time, as rings are read one by one.
+void
+sort(struct traceevent *e, int n)
+{
+  struct traceevent key;
+  int i, j;
+
+  for (i = 1; i < n; ++i) {
+    key = e[i];
+    for (j = i; j > 0 && e[j - 1].tsc > key.tsc; --j)
+      e[j] = e[j - 1];
+    e[j] = key;
+  }
+}
+
+void
+handle(struct traceevent *e)
+{
+  struct pstat *s;
+  struct wake *w;
+  struct cpustat *c;
+
+  s = e->pid ? findpstat(e->pid) : 0;
+  w = &wakes[e->tid % NWAKE];
+  c = &cpustats[e->cpu % NCPU];
+  switch (e->type) {
+  case TRACE_WAKEUP:
+    w->tid = e->tid;
+    w->tsc = e->tsc;
+    break;
+  case TRACE_SWITCHIN:
+    c->nswitch++;
+    if (c->lastout && e->tsc >= c->lastout)
+      c->overhead += e->tsc - c->lastout;
+    c->lastout = 0;
+    if (s)
+      s->nrun++;
+    if (s && w->tid == e->tid && e->tsc >= w->tsc)
+      s->latency[bucket(e->tsc - w->tsc)]++;
+    w->tid = 0;
+    break;
+  case TRACE_SWITCHOUT:
+    c->lastout = e->tsc;
+    if (s) {
+      s->runtime += (uint)e->arg;
+      s->runlen[bucket((uint)e->arg)]++;
+    }
+    break;
+  case TRACE_DEMOTE:
+    if (s)
+      s->ndemote++;
+    break;
+  case TRACE_PROMOTE:
+    if (s)
+      s->npromote++;
+    break;
+  case TRACE_LEND:
+    if (s)
+      s->nlend++;
+    break;
+  case TRACE_BOOST:
+    nboost++;
+    break;
+  case TRACE_IDLE:
+    c->lastout = 0;
+    break;
+  case TRACE_MISS:
+    nmiss++;
+    break;
+  case TRACE_LOST:
+    nlost += e->arg;
+    break;
+  }
+}
+
+// Read and handle the events queued now. Return their number.
+int
+drain(int keep)
+{
+  int i, n;
+
+  n = gettrace(batch, NBATCH);
+  if (n < 0) {
+    printf(1, "schedtrace: gettrace failed\n");
+    exit();
+  }
+  sort(batch, n);
+  for (i = 0; keep && i < n; ++i)
+    handle(&batch[i]);
+  return n;
+}
+
+void
+printhist(char *name, uint *hist)
+{
+  int b;
+
+  printf(1, "  %s:", name);
+  for (b = 0; b < NBUCKET; ++b)
+    printf(1, " %d", hist[b]);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage ru;
+  struct pstat *s;
+  struct cpustat *c;
+  int ticks, start, b;
+
+  ticks = argc >= 2 ? atoi(argv[1]) : 100;
+  getrusage(&ru);
+  tscpertick = ru.tscpertick;
+
+  // Drop what was recorded before.
+  while (drain(0) > 0)
+    ;
+  start = uptime();
+  while (uptime() - start < ticks) {
+    if (drain(1) < NBATCH)
+      sleep(1);
+  }
+  while (drain(1) > 0)
+    ;
+
+  printf(1, "%d ticks, %d boosts, %d deadline misses, %d events lost\n",
+         ticks, nboost, nmiss, nlost);
+  for (c = cpustats; c < &cpustats[NCPU]; ++c) {
+    if (c->nswitch == 0)
+      continue;
+    printf(1, "cpu %d: %d switches, scheduler overhead %d/10000 tick "
+           "per tick\n", c - cpustats, c->nswitch,
+           (uint)udiv64(c->overhead * 10000, tscpertick) / ticks);
+  }
+  printf(1, "buckets in 1/%d tick: <1", BUCKETUNIT);
+  for (b = 1; b < NBUCKET - 1; ++b)
+    printf(1, " <%d", 1 << b);
+  printf(1, " more\n");
+  for (s = pstats; s < &pstats[NPSTAT] && s->pid; ++s) {
+    printf(1, "pid %d: %d runs, %d demotions, %d promotions, %d lifts, "
+           "%d ticks of cpu\n", s->pid, s->nrun, s->ndemote, s->npromote,
+           s->nlend, (uint)udiv64(s->runtime, tscpertick));
+    printhist("latency", s->latency);
+    printhist("run", s->runlen);
+  }
+  exit();
+}
@@ -0,0 +1,93 @@
+/**
+ *  This program runs NTHREAD spinning threads in one process next to
+ * NHOG spinning processes, and gives the first thread its own cpu
+ * share with set_thread_share(). The other threads and the process
+ * stay in the MLFQ scheduler. The shared thread should count well
+ * ahead of its siblings.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD         4
+#define NHOG            2
+#define SHARE           40          // (%) share of the first thread
+#define LIFETIME        500         // (ticks)
+#define COUNT_PERIOD    100000      // (iteration)
+
+volatile int go;
+int cnt[NTHREAD];
+
+void
+spin(int *count)
+{
+  uint i, start;
+
+  start = uptime();
+  for (i = 0; uptime() - start < LIFETIME; ++i) {
+    // Prevent code optimization
+    __sync_synchronize();
+    if (i == COUNT_PERIOD) {
+      (*count)++;
+      i = 0;
+    }
+  }
+}
+
+void*
+spinmain(void *arg)
+{
+  while (!go)
+    yield();
+  spin(&cnt[(int)arg]);
+  thread_exit(0);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, others, dummy;
+  thread_t threads[NTHREAD];
+  void *retval;
+
+  for (i = 0; i < NHOG; ++i) {
+    if (fork() == 0) {
+      spin(&dummy);
+      exit();
+    }
+  }
+
+  for (i = 0; i < NTHREAD; ++i) {
+    if (thread_create(&threads[i], spinmain, (void*)i) != 0) {
+      printf(1, "sharetest: thread_create failed\n");
+      exit();
+    }
+  }
+  if (set_thread_share(threads[0], SHARE) != 0) {
+    printf(1, "sharetest: set_thread_share failed\n");
+    exit();
+  }
+  if (set_thread_share(threads[1], 100) != -1) {
+    printf(1, "sharetest: share over the budget accepted\n");
+    exit();
+  }
+  go = 1;
+
+  others = 0;
+  for (i = 0; i < NTHREAD; ++i) {
+    thread_join(threads[i], &retval);
+    printf(1, "thread %d: cnt %d\n", i, cnt[i]);
+    if (i > 0)
+      others += cnt[i];
+  }
+  for (i = 0; i < NHOG; ++i)
+    wait();
+
+  if (cnt[0] <= others / (NTHREAD - 1))
+    printf(1, "sharetest: shared thread did not get ahead\n");
+  else
+    printf(1, "sharetest ok\n");
+  exit();
+}
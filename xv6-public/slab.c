@@ -0,0 +1,91 @@
+// Object caches.
+// Objects are carved from whole pages of kalloc() and go back to
+// the free list of their cache when freed; pages are never returned.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slabobj {
+  struct slabobj *next;
+};
+
+void
+slabinit(struct slab *s, char *name, uint size)
+{
+  if(size < sizeof(struct slabobj) || size > PGSIZE)
+    panic("slabinit");
+  initlock(&s->lock, "slab");
+  s->name = name;
+  s->size = size;
+  s->free = 0;
+  s->npage = 0;
+}
+
+// Carve a new page into free objects.
+// Caller must hold s->lock.
+static int
+slabgrow(struct slab *s)
+{
+  char *page, *o;
+  struct slabobj *obj;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  memset(page, 0, PGSIZE);
+  for(o = page; o + s->size <= page + PGSIZE; o += s->size){
+    obj = (struct slabobj*)o;
+    obj->next = s->free;
+    s->free = obj;
+  }
+  s->npage++;
+  return 0;
+}
+
+// Allocate an object of s.
+// Returns 0 if the memory cannot be allocated.
+void*
+slaballoc(struct slab *s)
+{
+  struct slabobj *obj;
+
+  acquire(&s->lock);
+  if(s->free == 0 && slabgrow(s) < 0){
+    release(&s->lock);
+    return 0;
+  }
+  obj = s->free;
+  s->free = obj->next;
+  release(&s->lock);
+  return obj;
+}
+
+void
+slabfree(struct slab *s, void *v)
+{
+  struct slabobj *obj = v;
+
+  acquire(&s->lock);
+  obj->next = s->free;
+  s->free = obj;
+  release(&s->lock);
+}
+
+// Call f on every free object of s, e.g. to drop
+// resources cached in them. Return sum of results of f.
+int
+slabdrain(struct slab *s, int (*f)(void*))
+{
+  struct slabobj *obj;
+  int n;
+
+  n = 0;
+  acquire(&s->lock);
+  for(obj = s->free; obj; obj = obj->next)
+    n += f(obj);
+  release(&s->lock);
+  return n;
+}
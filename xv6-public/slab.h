@@ -0,0 +1,12 @@
+// Cache of fixed-size kernel objects carved from pages.
+// A free object keeps its contents except for the first word,
+// so objects may carry resources from one use to the next.
+struct slab {
+  struct spinlock lock;
+  struct slabobj *free;  // Free objects
+  uint size;             // Object size in bytes
+  uint npage;            // Pages taken from kalloc
+
+  // For debugging:
+  char *name;            // Name of cache.
+};
@@ -24,6 +24,8 @@ acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   while (lk->locked) {
+    // Keep the holder from starving below us meanwhile.
+    sleeplockboost(lk->pid);
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
@@ -0,0 +1,156 @@
+/**
+ *  This program measures the throughput of piping a file through
+ * a chain of processes, copying through user buffers with read/write
+ * compared to moving the data in the kernel with splice.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define FILENAME    "splicebench.dat"
+#define FILESIZE    (64 * 1024)   // (bytes)
+#define CHUNK       4096          // (bytes)
+#define NSTAGE      4             // default number of processes in chain
+#define NROUND      16            // default number of file passes
+
+char buf[CHUNK];
+
+// Write a file with a known byte pattern.
+int
+mkfile(void)
+{
+  int fd, i;
+
+  if ((fd = open(FILENAME, O_CREATE|O_RDWR)) < 0)
+    return -1;
+
+  for (i = 0; i < CHUNK; ++i)
+    buf[i] = i & 0xff;
+
+  for (i = 0; i < FILESIZE; i += CHUNK)
+    if (write(fd, buf, CHUNK) != CHUNK) {
+      close(fd);
+      return -1;
+    }
+
+  close(fd);
+  return 0;
+}
+
+// Forward everything from fd `in` to fd `out`.
+void
+forward(int in, int out, int usesplice)
+{
+  int n;
+  if (usesplice) {
+    while ((n = splice(in, out, CHUNK)) > 0)
+      ;
+  } else {
+    while ((n = read(in, buf, CHUNK)) > 0)
+      if (write(out, buf, n) != n)
+        break;
+  }
+}
+
+// Start a stage which reads fd `in` and writes fd `out`.
+int
+stage(int in, int out, int nround, int usesplice, int first)
+{
+  int pid, i, fd;
+  if ((pid = fork()) != 0)
+    return pid;
+
+  if (first) {
+    // The first stage reads the file `nround` times.
+    for (i = 0; i < nround; ++i) {
+      if ((fd = open(FILENAME, O_RDONLY)) < 0) {
+        printf(1, "splicebench: cannot open %s\n", FILENAME);
+        exit();
+      }
+      forward(fd, out, usesplice);
+      close(fd);
+    }
+  } else
+    forward(in, out, usesplice);
+
+  exit();
+}
+
+// Pipe the file through `nstage` processes and return elapsed ticks.
+int
+run(int nstage, int nround, int usesplice)
+{
+  int i, n, in, start, total;
+  int p[2];
+
+  start = uptime();
+
+  in = -1;
+  for (i = 0; i < nstage; ++i) {
+    if (pipe(p) < 0) {
+      printf(1, "splicebench: pipe failed\n");
+      exit();
+    }
+    if (stage(in, p[1], nround, usesplice, i == 0) < 0) {
+      printf(1, "splicebench: fork failed\n");
+      exit();
+    }
+    close(p[1]);
+    if (in >= 0)
+      close(in);
+    in = p[0];
+  }
+
+  // Drain the last pipe and check the amount of data.
+  total = 0;
+  while ((n = read(in, buf, CHUNK)) > 0)
+    total += n;
+  close(in);
+
+  for (i = 0; i < nstage; ++i)
+    wait();
+
+  if (total != FILESIZE * nround) {
+    printf(1, "splicebench: expected %d bytes, got %d\n",
+           FILESIZE * nround, total);
+    exit();
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nstage = NSTAGE;
+  int nround = NROUND;
+  int copy, spliced, kb;
+
+  if (argc >= 2)
+    nstage = atoi(argv[1]);
+  if (argc >= 3)
+    nround = atoi(argv[2]);
+  if (nstage < 1 || nround < 1) {
+    printf(1, "usage: splicebench [nstage] [nround]\n");
+    exit();
+  }
+
+  if (mkfile() < 0) {
+    printf(1, "splicebench: cannot create %s\n", FILENAME);
+    exit();
+  }
+
+  kb = FILESIZE / 1024 * nround;
+  copy = run(nstage, nround, 0);
+  spliced = run(nstage, nround, 1);
+
+  printf(1, "%d KB through %d stages\n", kb, nstage);
+  printf(1, "read/write: %d ticks (%d KB/tick)\n",
+         copy, copy ? kb / copy : kb);
+  printf(1, "splice:     %d ticks (%d KB/tick)\n",
+         spliced, spliced ? kb / spliced : kb);
+
+  unlink(FILENAME);
+  exit();
+}
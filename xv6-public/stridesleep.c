@@ -0,0 +1,135 @@
+/**
+ *  This program checks that the stride scheduler is work conserving.
+ * First NSPIN stride processes spin with small shares and nothing else
+ * to run. They should get the cpus, not wait for the MLFQ scheduler,
+ * which used to be charged a quantum for idling instead. Then a stride
+ * process sleeps for SLEEPTICKS next to NHOG MLFQ hogs and spins for
+ * BURSTTICKS. It gave its share to the hogs while it slept, and should
+ * not take it back by running through the whole burst.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "rusage.h"
+
+#define NSPIN         2
+#define SPINSHARE     10          // (%) share of a spinning process
+#define SPINTICKS     100         // (ticks) length of the first test
+#define NHOG          2
+#define SLEEPSHARE    10          // (%) share of the sleeping process
+#define SLEEPTICKS    300         // (ticks) sleep before the burst
+#define BURSTTICKS    40          // (ticks) burst after the sleep
+
+int fd[2];
+
+// Cpu time of this process in ticks.
+uint
+cputicks(void)
+{
+  struct rusage ru;
+
+  if (getrusage(&ru) < 0) {
+    printf(1, "stridesleep: getrusage failed\n");
+    exit();
+  }
+  return udiv64(ru.cputime, ru.tscpertick);
+}
+
+void
+spin(uint ticks)
+{
+  uint start;
+
+  start = uptime();
+  while (uptime() - start < ticks)
+    ;
+}
+
+// Run as a stride process with given share, report the cpu time
+// of a spin of given ticks after a sleep of given ticks.
+void
+strideproc(int share, uint sleepticks, uint spinticks)
+{
+  uint used;
+
+  close(fd[0]);
+  if (set_cpu_share(share) < 0) {
+    printf(1, "stridesleep: set_cpu_share failed\n");
+    used = 0;
+  } else {
+    sleep(sleepticks);
+    used = cputicks();
+    spin(spinticks);
+    used = cputicks() - used;
+  }
+  write(fd[1], &used, sizeof(used));
+  exit();
+}
+
+// Collect the reports of n processes, return their sum.
+uint
+collect(int n)
+{
+  uint used, total;
+  int i;
+
+  total = 0;
+  for (i = 0; i < n; ++i) {
+    if (read(fd[0], &used, sizeof(used)) != sizeof(used))
+      break;
+    total += used;
+  }
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, ok;
+  uint used;
+
+  ok = 1;
+  if (pipe(fd) < 0) {
+    printf(1, "stridesleep: pipe failed\n");
+    exit();
+  }
+  for (i = 0; i < NSPIN; ++i)
+    if (fork() == 0)
+      strideproc(SPINSHARE, 0, SPINTICKS);
+  used = collect(NSPIN);
+  for (i = 0; i < NSPIN; ++i)
+    wait();
+  printf(1, "spin: %d processes, %d ticks of cpu in %d ticks\n",
+         NSPIN, used, SPINTICKS);
+  if (used < SPINTICKS * 9 / 10) {
+    printf(1, "stridesleep: cpus idled next to stride processes\n");
+    ok = 0;
+  }
+
+  for (i = 0; i < NHOG; ++i) {
+    if (fork() == 0) {
+      close(fd[0]);
+      spin(SLEEPTICKS + BURSTTICKS);
+      exit();
+    }
+  }
+  if (fork() == 0)
+    strideproc(SLEEPSHARE, SLEEPTICKS, BURSTTICKS);
+  used = collect(1);
+  for (i = 0; i < NHOG + 1; ++i)
+    wait();
+  printf(1, "sleep: %d ticks of cpu in a burst of %d ticks\n",
+         used, BURSTTICKS);
+  if (used > BURSTTICKS * 3 / 4) {
+    printf(1, "stridesleep: sleeping process caught up on its share\n");
+    ok = 0;
+  }
+
+  if (ok)
+    printf(1, "stridesleep ok\n");
+  close(fd[0]);
+  close(fd[1]);
+  exit();
+}
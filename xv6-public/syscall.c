@@ -13,13 +13,21 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// Return end of the user memory containing addr,
+// the heap or a thread stack, or 0 if there is none.
+static uint
+uend(struct proc *p, uint addr)
+{
+  if(addr < p->sz)
+    return p->sz;
+  return ustackend(p, addr);
+}
+
 // Fetch the int at addr from the current process.
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(checkuptr(addr, 4) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,10 +42,9 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if((ep = (char*)uend(curproc, addr)) == 0)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -49,8 +56,20 @@ fetchstr(uint addr, char **pp)
 int
 argint(int n, int *ip)
 {
-  struct proc* p = myproc();
-  return fetchint((p->threads[p->tidx].tf->esp) + 4 + 4*n, ip);
+  return fetchint((mythread()->tf->esp) + 4 + 4*n, ip);
+}
+
+// Check that the block of memory of size bytes at addr
+// lies within the current process address space.
+int
+checkuptr(uint addr, int size)
+{
+  uint end;
+
+  if(size < 0 || (end = uend(myproc(), addr)) == 0 || addr+size > end ||
+     addr+size < addr)
+    return -1;
+  return 0;
 }
 
 // Fetch the nth word-sized system call argument as a pointer
@@ -60,11 +79,10 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(checkuptr((uint)i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -112,6 +130,26 @@ extern int sys_set_cpu_share(void);
 extern int sys_thread_create(void);
 extern int sys_thread_exit(void);
 extern int sys_thread_join(void);
+extern int sys_splice(void);
+extern int sys_fcntl(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_preadv(void);
+extern int sys_pwritev(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_thread_create_attr(void);
+extern int sys_freemem(void);
+extern int sys_thread_yield(void);
+extern int sys_set_thread_share(void);
+extern int sys_getrusage(void);
+extern int sys_gettrace(void);
+extern int sys_getmlfqparam(void);
+extern int sys_setmlfqparam(void);
+extern int sys_sched_deadline(void);
+extern int sys_sched_setaffinity(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -143,6 +181,26 @@ static int (*syscalls[])(void) = {
 [SYS_thread_join]     sys_thread_join,
 [SYS_pwrite]  sys_pwrite,
 [SYS_pread]   sys_pread,
+[SYS_splice]  sys_splice,
+[SYS_fcntl]   sys_fcntl,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_preadv]  sys_preadv,
+[SYS_pwritev] sys_pwritev,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_thread_create_attr] sys_thread_create_attr,
+[SYS_freemem] sys_freemem,
+[SYS_thread_yield] sys_thread_yield,
+[SYS_set_thread_share] sys_set_thread_share,
+[SYS_getrusage] sys_getrusage,
+[SYS_gettrace] sys_gettrace,
+[SYS_getmlfqparam] sys_getmlfqparam,
+[SYS_setmlfqparam] sys_setmlfqparam,
+[SYS_sched_deadline] sys_sched_deadline,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
 };
 
 void
@@ -150,7 +208,7 @@ syscall(void)
 {
   int num;
   struct proc *curproc = myproc();
-  struct thread *curthread = &curproc->threads[curproc->tidx];
+  struct thread *curthread = mythread();
 
   num = curthread->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
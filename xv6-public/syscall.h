@@ -28,3 +28,23 @@
 #define SYS_thread_join     27
 #define SYS_pwrite 28
 #define SYS_pread  29
+#define SYS_splice 30
+#define SYS_fcntl  31
+#define SYS_mmap   32
+#define SYS_munmap 33
+#define SYS_readv  34
+#define SYS_writev 35
+#define SYS_preadv 36
+#define SYS_pwritev 37
+#define SYS_futex_wait 38
+#define SYS_futex_wake 39
+#define SYS_thread_create_attr 40
+#define SYS_freemem 41
+#define SYS_thread_yield 42
+#define SYS_set_thread_share 43
+#define SYS_getrusage 44
+#define SYS_gettrace 45
+#define SYS_getmlfqparam 46
+#define SYS_setmlfqparam 47
+#define SYS_sched_deadline 48
+#define SYS_sched_setaffinity 49
@@ -13,8 +13,10 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "rangelock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -52,6 +54,27 @@ fdalloc(struct file *f)
   return -1;
 }
 
+// Fetch the nth and n+1th system call arguments as an array of
+// segments and its length. Copy the array into iov, checking that
+// every segment lies within the process address space.
+static int
+argiov(int n, struct iovec *iov, int *pcnt)
+{
+  int i, cnt;
+  char *uiov;
+
+  if(argint(n + 1, &cnt) < 0 || cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(argptr(n, &uiov, cnt * sizeof(struct iovec)) < 0)
+    return -1;
+  memmove(iov, uiov, cnt * sizeof(struct iovec));
+  for(i = 0; i < cnt; i++)
+    if(checkuptr((uint)iov[i].iov_base, iov[i].iov_len) < 0)
+      return -1;
+  *pcnt = cnt;
+  return 0;
+}
+
 int
 sys_dup(void)
 {
@@ -114,6 +137,98 @@ sys_pwrite(void)
   return filepwrite(f, p, n, off);
 }
 
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  return filefcntl(f, cmd, arg);
+}
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int addr, len, prot, flags, off;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  return mmap((uint)addr, len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap((uint)addr, len);
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+int
+sys_preadv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, off;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepreadv(f, iov, cnt, off);
+}
+
+int
+sys_pwritev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, off;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0 || argint(3, &off) < 0)
+    return -1;
+  return filepwritev(f, iov, cnt, off);
+}
+
 int
 sys_close(void)
 {
@@ -6,6 +6,10 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "thread.h"
+#include "rusage.h"
+#include "trace.h"
+#include "mlfqparam.h"
 
 int
 sys_fork(void)
@@ -82,12 +86,15 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-  uint xticks;
+  // Aligned load is atomic, and only the timer writes ticks.
+  return ticks;
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+// return number of free physical pages.
+int
+sys_freemem(void)
+{
+  return kfreepages();
 }
 
 int
@@ -116,6 +123,93 @@ sys_set_cpu_share(void)
   return set_cpu_share(n);
 }
 
+// move process to the deadline scheduling class
+// with given runtime every period.
+int
+sys_sched_deadline(void)
+{
+  int runtime, period;
+  if (argint(0, &runtime) < 0 || argint(1, &period) < 0)
+    return -1;
+
+  return sched_deadline(runtime, period);
+}
+
+// let a process or thread run only on given cpus.
+int
+sys_sched_setaffinity(void)
+{
+  int id, mask;
+  if (argint(0, &id) < 0 || argint(1, &mask) < 0)
+    return -1;
+
+  return sched_setaffinity(id, mask);
+}
+
+// Give a thread of this process its own cpu share.
+int
+sys_set_thread_share(void)
+{
+  int tid, n;
+  if (argint(0, &tid) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  return set_thread_share(tid, n);
+}
+
+// Report cpu time of this process and thread.
+int
+sys_getrusage(void)
+{
+  struct rusage *ru, r;
+  if (argptr(0, (char**)&ru, sizeof(*ru)) < 0)
+    return -1;
+
+  getrusage(&r);
+  *ru = r;
+  return 0;
+}
+
+int
+sys_gettrace(void)
+{
+  struct traceevent *buf;
+  int n;
+  if (argint(1, &n) < 0 || n < 0)
+    return -1;
+  // No more events than all rings and their lost records,
+  // which also keeps n * sizeof(*buf) from overflowing.
+  if (n > NCPU * (NTRACE + 1))
+    n = NCPU * (NTRACE + 1);
+  if (argptr(0, (char**)&buf, n * sizeof(*buf)) < 0)
+    return -1;
+
+  return traceread(buf, n);
+}
+
+int
+sys_getmlfqparam(void)
+{
+  struct mlfqparam *param, p;
+  if (argptr(0, (char**)&param, sizeof(*param)) < 0)
+    return -1;
+
+  getmlfqparam(&p);
+  *param = p;
+  return 0;
+}
+
+int
+sys_setmlfqparam(void)
+{
+  struct mlfqparam *param, p;
+  if (argptr(0, (char**)&param, sizeof(*param)) < 0)
+    return -1;
+
+  p = *param;
+  return setmlfqparam(&p);
+}
+
 int
 sys_thread_create(void)
 {
@@ -130,7 +224,35 @@ sys_thread_create(void)
   if (argptr(2, (char**)&arg, sizeof arg) < 0)
     return -1;
 
-  return thread_create(tid, start_routine, arg);
+  return thread_create(tid, 0, start_routine, arg);
+}
+
+int
+sys_thread_create_attr(void)
+{
+  int *tid, uattr;
+  struct thread_attr *attr, kattr;
+  void*(*start_routine)(void*);
+  void *arg;
+
+  if (argptr(0, (char**)&tid, sizeof tid) < 0)
+    return -1;
+  if (argint(1, &uattr) < 0)
+    return -1;
+  if (argptr(2, (char**)&start_routine, sizeof start_routine) < 0)
+    return -1;
+  if (argptr(3, (char**)&arg, sizeof arg) < 0)
+    return -1;
+
+  // Null attributes select the defaults.
+  attr = 0;
+  if (uattr != 0) {
+    if (argptr(1, (char**)&attr, sizeof *attr) < 0)
+      return -1;
+    kattr = *attr;
+    attr = &kattr;
+  }
+  return thread_create(tid, attr, start_routine, arg);
 }
 
 int
@@ -156,3 +278,36 @@ sys_thread_join(void)
   
   return thread_join(tid, retval);
 }
+
+// Switch to sibling thread tid if it is runnable.
+int
+sys_thread_yield(void)
+{
+  int tid;
+  if (argint(0, &tid) < 0)
+    return -1;
+
+  return thread_yield(tid);
+}
+
+// Sleep while *addr equals val.
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+  if (argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+
+  return futex_wait((int*)addr, val);
+}
+
+// Wake up to n threads waiting on addr.
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+  if (argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+
+  return futex_wake((int*)addr, n);
+}
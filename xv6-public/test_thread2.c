@@ -3,7 +3,8 @@
 #include "user.h"
 
 #define NUM_THREAD 10
-#define NTEST 14
+#define NTEST 16
+#define NUM_MANY 200
 
 // Show race condition
 int racingtest(void);
@@ -41,6 +42,12 @@ int sleeptest(void);
 // Test behavior when we use cpu_share with thread
 int stridetest(void);
 
+// Test thread_join on invalid and already joined threads
+int jointest3(void);
+
+// Test many more threads than the old fixed slots
+int manytest(void);
+
 volatile int gcnt;
 int gpipe[2];
 
@@ -59,6 +66,8 @@ int (*testfunc[NTEST])(void) = {
   pipetest,
   sleeptest,
   stridetest,
+  jointest3,
+  manytest,
 };
 char *testname[NTEST] = {
   "racingtest",
@@ -75,6 +84,8 @@ char *testname[NTEST] = {
   "pipetest",
   "sleeptest",
   "stridetest",
+  "jointest3",
+  "manytest",
 };
 
 int
@@ -267,6 +278,68 @@ jointest2(void)
   return 0;
 }
 
+int
+jointest3(void)
+{
+  thread_t thread;
+  void *retval;
+
+  if (thread_join(0, &retval) != -1 || thread_join(-1, &retval) != -1){
+    printf(1, "panic at thread_join of invalid tid\n");
+    return -1;
+  }
+  if (thread_create(&thread, jointhreadmain, (void*)1) != 0){
+    printf(1, "panic at thread_create\n");
+    return -1;
+  }
+  if (thread_join(thread, &retval) != 0 || (int)retval != 2){
+    printf(1, "panic at thread_join\n");
+    return -1;
+  }
+  if (thread_join(thread, &retval) != -1){
+    printf(1, "panic at thread_join of joined thread\n");
+    return -1;
+  }
+  printf(1,"\n");
+  return 0;
+}
+
+void*
+manythreadmain(void *arg)
+{
+  // Stay alive until every thread is created.
+  while (gcnt == 0)
+    sleep(1);
+  thread_exit((void*)((int)arg + 1));
+
+  return 0;
+}
+
+int
+manytest(void)
+{
+  thread_t threads[NUM_MANY];
+  int i;
+  void *retval;
+
+  gcnt = 0;
+  for (i = 0; i < NUM_MANY; i++){
+    if (thread_create(&threads[i], manythreadmain, (void*)i) != 0){
+      printf(1, "panic at thread_create %d\n", i);
+      return -1;
+    }
+  }
+  gcnt = 1;
+  for (i = 0; i < NUM_MANY; i++){
+    if (thread_join(threads[i], &retval) != 0 || (int)retval != i+1){
+      printf(1, "panic at thread_join %d\n", i);
+      return -1;
+    }
+  }
+  printf(1,"\n");
+  return 0;
+}
+
 // ============================================================================
 
 void*
@@ -0,0 +1,9 @@
+// Attributes of thread_create_attr, zero for defaults.
+struct thread_attr {
+  uint stacksize;   // bytes of user stack, PGSIZE if zero
+  uint guardsize;   // bytes of inaccessible pages below the stack
+  void *tls;        // base of thread-local block, addressed by %gs
+  uint tlssize;     // bytes of thread-local block, at most MAXTLS
+};
+
+#define MAXTLS  0x100000  // byte granular segment limit
@@ -0,0 +1,6 @@
+// Time page, mapped read-only at TIMEPAGE in every process,
+// so that user programs read the time without a system call.
+struct timepage {
+  volatile uint ticks;        // timer ticks since boot
+  volatile uint tscpertick;   // (cycles) measured length of a tick
+};
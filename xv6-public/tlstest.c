@@ -0,0 +1,172 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "thread.h"
+
+#define NTHREAD   4
+#define NITER     1000
+#define DEPTH     200     // recursion depth of deep stack test
+#define FRAME     512     // (bytes) stack used per recursion
+#define GUARD     4096    // (bytes) one page
+
+int tlstest(void);
+int stacktest(void);
+int guardtest(void);
+
+int (*testfunc[])(void) = {
+  tlstest,
+  stacktest,
+  guardtest,
+};
+char *testname[] = {
+  "tlstest",
+  "stacktest",
+  "guardtest",
+};
+
+// Thread-local block, word 0 points to the block itself.
+struct tls {
+  struct tls *self;
+  int id;
+  int count;
+};
+
+struct tls blocks[NTHREAD];
+
+// ============================================================================
+void*
+tlsthreadmain(void *arg)
+{
+  int i;
+  struct tls *tls;
+
+  for (i = 0; i < NITER; i++) {
+    tls = tls_self();
+    if (tls != &blocks[(int)arg] || tls->id != (int)arg)
+      thread_exit((void*)1);
+    tls->count++;
+    // Other threads run on this cpu in between.
+    if (i % 100 == 0)
+      yield();
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int
+tlstest(void)
+{
+  int i;
+  void *retval;
+  thread_t tid[NTHREAD];
+  struct thread_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  for (i = 0; i < NTHREAD; i++) {
+    blocks[i].self = &blocks[i];
+    blocks[i].id = i;
+    blocks[i].count = 0;
+    attr.tls = &blocks[i];
+    attr.tlssize = sizeof(blocks[i]);
+    if (thread_create_attr(&tid[i], &attr, tlsthreadmain, (void*)i) != 0)
+      return -1;
+  }
+  for (i = 0; i < NTHREAD; i++) {
+    if (thread_join(tid[i], &retval) != 0 || retval != 0)
+      return -1;
+    if (blocks[i].count != NITER)
+      return -1;
+  }
+  // Oversized blocks are refused.
+  attr.tlssize = MAXTLS + 1;
+  if (thread_create_attr(&tid[0], &attr, tlsthreadmain, 0) != -1)
+    return -1;
+  return 0;
+}
+
+// ============================================================================
+int
+recurse(int depth)
+{
+  volatile char frame[FRAME];
+
+  frame[0] = depth;
+  if (depth == 0)
+    return 0;
+  return recurse(depth - 1) + frame[0] - depth + 1;
+}
+
+void*
+stackthreadmain(void *arg)
+{
+  thread_exit((void*)recurse((int)arg));
+  return 0;
+}
+
+int
+stacktest(void)
+{
+  void *retval;
+  thread_t tid;
+  struct thread_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.stacksize = DEPTH * (FRAME + 64);
+  attr.guardsize = GUARD;
+  if (thread_create_attr(&tid, &attr, stackthreadmain, (void*)DEPTH) != 0 ||
+      thread_join(tid, &retval) != 0)
+    return -1;
+  return retval == (void*)DEPTH ? 0 : -1;
+}
+
+// ============================================================================
+// Overflow the default stack into its guard page in a child process,
+// which must be killed before it reports back.
+int
+guardtest(void)
+{
+  int pid, fds[2];
+  char c;
+  void *retval;
+  thread_t tid;
+  struct thread_attr attr;
+
+  if (pipe(fds) < 0)
+    return -1;
+  if ((pid = fork()) < 0)
+    return -1;
+  if (pid == 0) {
+    close(fds[0]);
+    memset(&attr, 0, sizeof(attr));
+    attr.guardsize = GUARD;
+    if (thread_create_attr(&tid, &attr, stackthreadmain, (void*)DEPTH) == 0)
+      thread_join(tid, &retval);
+    write(fds[1], "x", 1);
+    exit();
+  }
+  close(fds[1]);
+  if (read(fds[0], &c, 1) != 0) {
+    close(fds[0]);
+    wait();
+    return -1;
+  }
+  close(fds[0]);
+  wait();
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  for (i = 0; i < sizeof(testfunc) / sizeof(testfunc[0]); i++) {
+    printf(1, "%d. %s start\n", i, testname[i]);
+    if (testfunc[i]() != 0) {
+      printf(1, "%d. %s panic\n", i, testname[i]);
+      exit();
+    }
+    printf(1, "%d. %s finish\n", i, testname[i]);
+  }
+  exit();
+}
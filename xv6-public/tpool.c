@@ -0,0 +1,293 @@
+//
+// Thread pool with work stealing.
+// Every worker owns a deque of tasks. A worker runs its newest task
+// first, and when its deque is empty it takes the oldest task of
+// the pool queue or of another worker. Tasks submitted by threads
+// outside the pool go to the pool queue. Idle workers sleep on a
+// condition variable until tasks are queued.
+//
+
+#include "types.h"
+#include "user.h"
+#include "thread.h"
+#include "tpool.h"
+
+static void
+dequeinit(struct tpool_deque *q)
+{
+  mutex_init(&q->lock);
+  q->top = 0;
+  q->bottom = 0;
+}
+
+// Return -1 if the deque is full.
+static int
+dequepush(struct tpool_deque *q, struct tpool_task *t)
+{
+  mutex_lock(&q->lock);
+  if(q->bottom - q->top == TPOOL_DEQUE){
+    mutex_unlock(&q->lock);
+    return -1;
+  }
+  q->task[q->bottom++ % TPOOL_DEQUE] = t;
+  mutex_unlock(&q->lock);
+  return 0;
+}
+
+// Take newest task if lifo, else the oldest one.
+static struct tpool_task*
+dequetake(struct tpool_deque *q, int lifo)
+{
+  struct tpool_task *t;
+
+  // Racy peek, so that thieves skip empty deques without locking.
+  if(q->bottom == q->top)
+    return 0;
+  mutex_lock(&q->lock);
+  t = 0;
+  if(q->bottom != q->top){
+    if(lifo)
+      t = q->task[--q->bottom % TPOOL_DEQUE];
+    else
+      t = q->task[q->top++ % TPOOL_DEQUE];
+  }
+  mutex_unlock(&q->lock);
+  return t;
+}
+
+// Worker of the calling thread, or 0 if it is not one of pool.
+static struct tpool_worker*
+myworker(struct tpool *pool)
+{
+  ushort gs;
+  struct tpool_worker *w;
+
+  // Threads without thread-local block have a null %gs.
+  asm volatile("movw %%gs, %0" : "=r" (gs));
+  if(gs == 0)
+    return 0;
+  w = tls_self();
+  if(w < pool->worker || w >= &pool->worker[pool->nworker])
+    return 0;
+  return w;
+}
+
+// Find a task: own deque, then pool queue, then steal.
+static struct tpool_task*
+take(struct tpool *pool, struct tpool_worker *w)
+{
+  struct tpool_task *t;
+  int i, start;
+
+  if(pool->pending == 0)
+    return 0;
+  if(w && (t = dequetake(&w->q, 1)) != 0)
+    goto found;
+  if((t = dequetake(&pool->inject, 0)) != 0)
+    goto found;
+  start = w ? w->id + 1 : 0;
+  for(i = 0; i < pool->nworker; i++){
+    if((t = dequetake(&pool->worker[(start + i) % pool->nworker].q, 0)) != 0)
+      goto found;
+  }
+  return 0;
+
+found:
+  __sync_fetch_and_sub(&pool->pending, 1);
+  return t;
+}
+
+static void
+run(struct tpool_task *t)
+{
+  t->fn(t->arg);
+  __sync_synchronize();
+  t->done = 1;
+}
+
+static void*
+workermain(void *arg)
+{
+  struct tpool_worker *w = arg;
+  struct tpool *pool = w->pool;
+  struct tpool_task *t;
+  int stop;
+
+  for(;;){
+    if((t = take(pool, w)) != 0){
+      run(t);
+      continue;
+    }
+    // Count as idle before looking at pending,
+    // so that submitters see us and wake us up.
+    mutex_lock(&pool->lock);
+    __sync_fetch_and_add(&pool->idle, 1);
+    while(pool->pending == 0 && !pool->stop)
+      cond_wait(&pool->wake, &pool->lock);
+    __sync_fetch_and_sub(&pool->idle, 1);
+    stop = pool->stop && pool->pending == 0;
+    mutex_unlock(&pool->lock);
+    if(stop)
+      break;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+// Start nworker workers. Return -1 on failure.
+int
+tpool_init(struct tpool *pool, int nworker)
+{
+  struct thread_attr attr;
+  struct tpool_worker *w;
+  int i;
+
+  if(nworker <= 0 || nworker > TPOOL_MAXWORKER)
+    return -1;
+  pool->nworker = 0;
+  pool->pending = 0;
+  pool->idle = 0;
+  pool->stop = 0;
+  dequeinit(&pool->inject);
+  mutex_init(&pool->lock);
+  cond_init(&pool->wake);
+
+  for(i = 0; i < nworker; i++){
+    w = &pool->worker[i];
+    w->self = w;
+    w->pool = pool;
+    w->id = i;
+    dequeinit(&w->q);
+
+    // Worker finds itself through its thread-local block.
+    memset(&attr, 0, sizeof(attr));
+    attr.stacksize = TPOOL_STACK;
+    attr.tls = w;
+    attr.tlssize = sizeof(*w);
+    if(thread_create_attr(&w->tid, &attr, workermain, w) != 0){
+      tpool_destroy(pool);
+      return -1;
+    }
+    pool->nworker++;
+  }
+  return 0;
+}
+
+// Run the queued tasks and stop the workers.
+void
+tpool_destroy(struct tpool *pool)
+{
+  void *retval;
+  int i;
+
+  mutex_lock(&pool->lock);
+  pool->stop = 1;
+  cond_broadcast(&pool->wake);
+  mutex_unlock(&pool->lock);
+  for(i = 0; i < pool->nworker; i++)
+    thread_join(pool->worker[i].tid, &retval);
+  pool->nworker = 0;
+}
+
+// Return id of the calling worker, or -1 outside of the pool.
+int
+tpool_self(struct tpool *pool)
+{
+  struct tpool_worker *w;
+
+  if((w = myworker(pool)) == 0)
+    return -1;
+  return w->id;
+}
+
+// Queue fn(arg) as task t. If the queue is full the task
+// runs right away in the caller.
+void
+tpool_submit(struct tpool *pool, struct tpool_task *t,
+             void (*fn)(void*), void *arg)
+{
+  struct tpool_worker *w;
+
+  t->fn = fn;
+  t->arg = arg;
+  t->done = 0;
+  w = myworker(pool);
+  __sync_fetch_and_add(&pool->pending, 1);
+  if(dequepush(w ? &w->q : &pool->inject, t) < 0){
+    __sync_fetch_and_sub(&pool->pending, 1);
+    run(t);
+    return;
+  }
+  if(pool->idle > 0){
+    mutex_lock(&pool->lock);
+    cond_signal(&pool->wake);
+    mutex_unlock(&pool->lock);
+  }
+}
+
+// Wait until task t is done, running other tasks meanwhile
+// so that tasks waiting for their subtasks cannot deadlock.
+void
+tpool_join(struct tpool *pool, struct tpool_task *t)
+{
+  struct tpool_worker *w;
+  struct tpool_task *other;
+
+  w = myworker(pool);
+  while(!t->done){
+    if((other = take(pool, w)) != 0)
+      run(other);
+    else
+      yield();
+  }
+  __sync_synchronize();
+}
+
+struct forarg {
+  struct tpool *pool;
+  int begin, end, grain;
+  void (*fn)(int, int, void*);
+  void *arg;
+};
+
+// Split range in halves, queue one and go on with the other.
+static void
+forrange(void *v)
+{
+  struct forarg *a = v;
+  struct forarg left, right;
+  struct tpool_task t;
+  int mid;
+
+  if(a->end - a->begin <= a->grain){
+    a->fn(a->begin, a->end, a->arg);
+    return;
+  }
+  mid = a->begin + (a->end - a->begin) / 2;
+  left = *a;
+  left.end = mid;
+  right = *a;
+  right.begin = mid;
+  tpool_submit(a->pool, &t, forrange, &right);
+  forrange(&left);
+  tpool_join(a->pool, &t);
+}
+
+// Call fn(b, e, arg) on pieces [b, e) of [begin, end) of at
+// most grain elements in parallel. Return when all are done.
+void
+tpool_for(struct tpool *pool, int begin, int end, int grain,
+          void (*fn)(int, int, void*), void *arg)
+{
+  struct forarg a;
+
+  if(grain <= 0)
+    grain = 1;
+  a.pool = pool;
+  a.begin = begin;
+  a.end = end;
+  a.grain = grain;
+  a.fn = fn;
+  a.arg = arg;
+  forrange(&a);
+}
@@ -0,0 +1,52 @@
+// Thread pool with work stealing, see tpool.c.
+// Needs user.h for mutex_t, cond_t and thread_t.
+
+#define TPOOL_MAXWORKER  16
+#define TPOOL_DEQUE      256       // tasks queued per worker
+#define TPOOL_STACK      0x4000    // (bytes) stack of a worker
+
+// Unit of work. Lives with the submitter until tpool_join returns.
+struct tpool_task {
+  void (*fn)(void*);
+  void *arg;
+  volatile int done;
+};
+
+// Tasks of a worker. The owner pushes and pops at the bottom,
+// thieves take the oldest task at the top.
+struct tpool_deque {
+  mutex_t lock;
+  int top;
+  int bottom;
+  struct tpool_task *task[TPOOL_DEQUE];
+};
+
+struct tpool;
+
+// Worker, also its thread-local block: word 0 points to itself.
+struct tpool_worker {
+  struct tpool_worker *self;
+  struct tpool *pool;
+  int id;
+  thread_t tid;
+  struct tpool_deque q;
+};
+
+struct tpool {
+  int nworker;
+  struct tpool_worker worker[TPOOL_MAXWORKER];
+  struct tpool_deque inject;    // tasks from threads outside the pool
+  volatile int pending;         // tasks queued in all deques
+  volatile int idle;            // workers about to sleep
+  volatile int stop;
+  mutex_t lock;                 // guards sleeping on wake
+  cond_t wake;
+};
+
+int  tpool_init(struct tpool*, int nworker);
+void tpool_destroy(struct tpool*);
+int  tpool_self(struct tpool*);
+void tpool_submit(struct tpool*, struct tpool_task*, void (*)(void*), void*);
+void tpool_join(struct tpool*, struct tpool_task*);
+void tpool_for(struct tpool*, int begin, int end, int grain,
+               void (*)(int, int, void*), void*);
@@ -0,0 +1,152 @@
+/**
+ *  This program sums and sorts an array with a thread pool of
+ * 1, 2 and 4 workers and reports the ticks taken by each. With more
+ * than one cpu the times should drop as workers are added.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "tpool.h"
+
+#define NELEM       0x10000   // elements of the array
+#define SUMGRAIN    0x1000    // elements summed by one task
+#define SORTGRAIN   0x800     // sorted sequentially below this
+#define NROUND      20        // sums per measurement
+
+struct tpool pool;
+int *data, *sorted, *tmp;
+volatile int total;
+
+uint seed = 1;
+
+uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+void
+sumrange(int begin, int end, void *arg)
+{
+  int i, s;
+
+  s = 0;
+  for (i = begin; i < end; ++i)
+    s += data[i];
+  __sync_fetch_and_add(&total, s);
+}
+
+void
+merge(int *a, int *t, int begin, int mid, int end)
+{
+  int i, j, k;
+
+  i = begin;
+  j = mid;
+  for (k = begin; k < end; ++k) {
+    if (j >= end || (i < mid && a[i] <= a[j]))
+      t[k] = a[i++];
+    else
+      t[k] = a[j++];
+  }
+  memmove(a + begin, t + begin, (end - begin) * sizeof(int));
+}
+
+void
+mergesort(int *a, int *t, int begin, int end)
+{
+  int mid;
+
+  if (end - begin < 2)
+    return;
+  mid = begin + (end - begin) / 2;
+  mergesort(a, t, begin, mid);
+  mergesort(a, t, mid, end);
+  merge(a, t, begin, mid, end);
+}
+
+struct sortarg {
+  int begin, end;
+};
+
+// Sort halves as separate tasks, then merge them.
+void
+sorttask(void *v)
+{
+  struct sortarg *a = v;
+  struct sortarg left, right;
+  struct tpool_task t;
+  int mid;
+
+  if (a->end - a->begin <= SORTGRAIN) {
+    mergesort(sorted, tmp, a->begin, a->end);
+    return;
+  }
+  mid = a->begin + (a->end - a->begin) / 2;
+  left.begin = a->begin;
+  left.end = mid;
+  right.begin = mid;
+  right.end = a->end;
+  tpool_submit(&pool, &t, sorttask, &right);
+  sorttask(&left);
+  tpool_join(&pool, &t);
+  merge(sorted, tmp, a->begin, mid, a->end);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nworker, i, expect, start, sumticks, sortticks;
+  struct sortarg all;
+
+  data = malloc(NELEM * sizeof(int));
+  sorted = malloc(NELEM * sizeof(int));
+  tmp = malloc(NELEM * sizeof(int));
+  if (data == 0 || sorted == 0 || tmp == 0) {
+    printf(1, "tpoolbench: out of memory\n");
+    exit();
+  }
+  expect = 0;
+  for (i = 0; i < NELEM; ++i) {
+    data[i] = rand() % 1000;
+    expect += data[i];
+  }
+
+  for (nworker = 1; nworker <= 4; nworker *= 2) {
+    if (tpool_init(&pool, nworker) != 0) {
+      printf(1, "tpoolbench: tpool_init failed\n");
+      exit();
+    }
+
+    start = uptime();
+    for (i = 0; i < NROUND; ++i) {
+      total = 0;
+      tpool_for(&pool, 0, NELEM, SUMGRAIN, sumrange, 0);
+      if (total != expect) {
+        printf(1, "tpoolbench: sum %d, expected %d\n", total, expect);
+        exit();
+      }
+    }
+    sumticks = uptime() - start;
+
+    memmove(sorted, data, NELEM * sizeof(int));
+    all.begin = 0;
+    all.end = NELEM;
+    start = uptime();
+    sorttask(&all);
+    sortticks = uptime() - start;
+    for (i = 1; i < NELEM; ++i) {
+      if (sorted[i - 1] > sorted[i]) {
+        printf(1, "tpoolbench: not sorted at %d\n", i);
+        exit();
+      }
+    }
+
+    tpool_destroy(&pool);
+    printf(1, "%d workers: sum %d ticks, sort %d ticks\n",
+           nworker, sumticks, sortticks);
+  }
+  exit();
+}
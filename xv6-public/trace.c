@@ -0,0 +1,98 @@
+// Scheduler trace.
+// Every cpu records events in its own ring with interrupts off,
+// so the writer needs no lock. A full ring drops new events and
+// counts them. gettrace() takes the events out of all rings,
+// readers are serialized with a sleep lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "trace.h"
+
+struct tracering {
+  volatile uint head;     // next event to write, by the cpu
+  volatile uint tail;     // next event to read, by gettrace
+  uint lost;              // events dropped on a full ring
+  uint reported;          // lost events already reported
+  struct traceevent event[NTRACE];
+};
+
+static struct tracering rings[NCPU];
+static struct sleeplock tracelock;
+
+void
+traceinit(void)
+{
+  initsleeplock(&tracelock, "trace");
+}
+
+// Record an event on the ring of this cpu.
+void
+trace(int type, int pid, int tid, int arg)
+{
+  struct tracering *r;
+  struct traceevent *e;
+  uint head;
+
+  pushcli();
+  r = &rings[cpuid()];
+  head = r->head;
+  if(head - r->tail == NTRACE){
+    r->lost++;
+    popcli();
+    return;
+  }
+  e = &r->event[head % NTRACE];
+  e->tsc = rdtsc();
+  e->type = type;
+  e->cpu = r - rings;
+  e->pid = pid;
+  e->tid = tid;
+  e->arg = arg;
+  // Publish the event after it is written.
+  __sync_synchronize();
+  r->head = head + 1;
+  popcli();
+}
+
+// Move up to n events to dst, ring by ring.
+// Return the number of events moved.
+int
+traceread(struct traceevent *dst, int n)
+{
+  struct tracering *r;
+  uint head, tail, lost;
+  int i;
+
+  acquiresleep(&tracelock);
+  i = 0;
+  for(r = rings; r < &rings[ncpu] && i < n; r++){
+    lost = r->lost;
+    if(lost != r->reported){
+      dst[i].tsc = rdtsc();
+      dst[i].type = TRACE_LOST;
+      dst[i].cpu = r - rings;
+      dst[i].pid = 0;
+      dst[i].tid = 0;
+      dst[i].arg = lost - r->reported;
+      r->reported = lost;
+      i++;
+    }
+    head = r->head;
+    // Read the events after their publication.
+    __sync_synchronize();
+    for(tail = r->tail; tail != head && i < n; tail++)
+      dst[i++] = r->event[tail % NTRACE];
+    // Hand the slots back after they are read.
+    __sync_synchronize();
+    r->tail = tail;
+  }
+  releasesleep(&tracelock);
+  return i;
+}
@@ -0,0 +1,21 @@
+// Scheduler events, drained from the per-cpu rings by gettrace().
+#define TRACE_SWITCHIN    1   // thread got the cpu, arg: MLFQ level or -1
+#define TRACE_SWITCHOUT   2   // thread left the cpu, arg: cycles it ran
+#define TRACE_DEMOTE      3   // process moved down, arg: new level
+#define TRACE_BOOST       4   // process moved to the top level
+#define TRACE_PASS        5   // stride pass advanced, arg: new pass
+#define TRACE_WAKEUP      6   // thread made runnable
+#define TRACE_LOST        7   // ring of cpu was full, arg: events lost
+#define TRACE_LEND        8   // lock holder lifted, arg: new level
+#define TRACE_PROMOTE     9   // process woke up a level higher, arg: level
+#define TRACE_MISS       10   // deadline passed with budget left, arg: it
+#define TRACE_IDLE       11   // cpu found nothing to run
+
+struct traceevent {
+  uint64 tsc;       // time-stamp counter of the event
+  ushort type;      // TRACE_*
+  ushort cpu;       // cpu the event happened on
+  int pid;          // process, or 0
+  int tid;          // thread, or 0
+  int arg;          // depends on type
+};
@@ -8,6 +8,7 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "timepage.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -15,6 +16,11 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 
+// Time-stamp counter cycles per tick, measured on every tick of
+// cpu 0 and smoothed. The guess is used until the first ticks.
+uint tscpertick = 10000000;
+static uint64 lasttsc;
+
 // For preventing improper cpu yield for MLFQ.
 extern int sys_uptime();
 extern struct mlfq mlfq;
@@ -42,9 +48,8 @@ void
 trap(struct trapframe *tf)
 {
   struct proc *p = myproc();
-  struct thread *t = 0;
-  if (p)
-    t = &p->threads[p->tidx];
+  struct thread *t = mythread();
+  uint64 tsc;
 
   if(tf->trapno == T_SYSCALL){
     if(p->killed)
@@ -59,13 +64,30 @@ trap(struct trapframe *tf)
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
     if(cpuid() == 0){
+      tsc = rdtsc();
+      if(lasttsc)
+        tscpertick = (tscpertick * 7 + (uint)(tsc - lasttsc)) / 8;
+      lasttsc = tsc;
+
       acquire(&tickslock);
       ticks++;
+      timepage->ticks = ticks;
+      timepage->tscpertick = tscpertick;
       wakeup(&ticks);
       release(&tickslock);
     }
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_WAKE:
+    // Only wakes the cpu up from hlt in the scheduler.
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLB:
+    // Page table loaded here lost pages, see tlbshootdown.
+    lcr3(rcr3());
+    mycpu()->tlbflushes++;
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -88,6 +110,12 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Load page of a file mapping on first access.
+    if(p && (tf->cs&3) == DPL_USER && mmapfault(p, rcr2(), tf->err & FEC_WR) == 0)
+      break;
+    // Otherwise it is an ordinary fault.
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -101,7 +129,7 @@ trap(struct trapframe *tf)
             "eip 0x%x addr 0x%x--kill proc\n",
             p->pid, p->name, tf->trapno,
             tf->err, cpuid(), tf->eip, rcr2());
-    p->killed = 1;
+    p->killed |= KILL_PROC;
   }
 
   // Force process exit if it has been killed and is in user space.
@@ -0,0 +1,7 @@
+// Segment of scatter/gather I/O
+struct iovec {
+  void *iov_base;  // Start of segment
+  int iov_len;     // Length of segment in bytes
+};
+
+#define IOV_MAX  16  // maximum number of segments per call
@@ -3,6 +3,8 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "memlayout.h"
+#include "timepage.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +106,129 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Return word 0 of the thread-local block, by convention
+// a pointer to the block itself.
+void*
+tls_self(void)
+{
+  void *self;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (self));
+  return self;
+}
+
+// Mutex on a single word: 0 unlocked, 1 locked, 2 locked
+// with possible waiters. Lock and unlock enter the kernel only
+// when the mutex is contended.
+void
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // Announce a waiter, then sleep until the holder releases.
+  if(c != 2)
+    c = xchg((uint*)&m->state, 2);
+  while(c != 0){
+    futex_wait((int*)&m->state, 2);
+    c = xchg((uint*)&m->state, 2);
+  }
+}
+
+// Return 0 if the mutex was taken, -1 if it is held.
+int
+mutex_trylock(mutex_t *m)
+{
+  return __sync_val_compare_and_swap(&m->state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    futex_wake((int*)&m->state, 1);
+  }
+}
+
+// Condition variable: waiters sleep until seq changes.
+void
+cond_init(cond_t *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+  int seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait((int*)&c->seq, seq);
+  // Other waiters may sleep on m as well, so relock as contended.
+  while(xchg((uint*)&m->state, 2) != 0)
+    futex_wait((int*)&m->state, 2);
+}
+
+void
+cond_signal(cond_t *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake((int*)&c->seq, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake((int*)&c->seq, 0x7fffffff);
+}
+
+// Barrier of n threads.
+void
+barrier_init(barrier_t *b, int n)
+{
+  mutex_init(&b->lock);
+  cond_init(&b->cond);
+  b->n = n;
+  b->count = 0;
+  b->phase = 0;
+}
+
+// Wait until n threads have arrived.
+// Return 1 in the last thread to arrive, 0 in the others.
+int
+barrier_wait(barrier_t *b)
+{
+  int phase;
+
+  mutex_lock(&b->lock);
+  phase = b->phase;
+  if(++b->count == b->n){
+    b->count = 0;
+    b->phase++;
+    cond_broadcast(&b->cond);
+    mutex_unlock(&b->lock);
+    return 1;
+  }
+  while(phase == b->phase)
+    cond_wait(&b->cond, &b->lock);
+  mutex_unlock(&b->lock);
+  return 0;
+}
+
+// Ticks since boot, read from the time page without a system call.
+uint
+readticks(void)
+{
+  return ((struct timepage*)TIMEPAGE)->ticks;
+}
@@ -0,0 +1,88 @@
+/**
+ *  This program counts how many times the tick counter can be read
+ * per tick, with the uptime system call and from the time page with
+ * readticks(), by one process and by NPROCS processes at once.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NPROCS      2       // processes reading at once
+#define RUNTICKS    50      // (ticks) length of a measurement
+
+int
+sysuptime(void)
+{
+  return uptime();
+}
+
+int
+pageuptime(void)
+{
+  return readticks();
+}
+
+// Read with fn for RUNTICKS ticks, return the reads per tick.
+int
+count(int (*fn)(void))
+{
+  int start, n;
+
+  start = fn();
+  while (fn() == start)
+    ;
+  start++;
+  for (n = 0; fn() - start < RUNTICKS; ++n)
+    ;
+  return n / RUNTICKS;
+}
+
+// Run count in nproc processes, return the sum of their reads.
+int
+run(int (*fn)(void), int nproc)
+{
+  int i, n, total, fd[2];
+
+  if (pipe(fd) < 0) {
+    printf(1, "uptimebench: pipe failed\n");
+    exit();
+  }
+  for (i = 0; i < nproc; ++i) {
+    if (fork() == 0) {
+      close(fd[0]);
+      n = count(fn);
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+  total = 0;
+  while (read(fd[0], &n, sizeof(n)) == sizeof(n))
+    total += n;
+  close(fd[0]);
+  for (i = 0; i < nproc; ++i)
+    wait();
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int before, page, after;
+
+  // Time page is in step with uptime.
+  before = uptime();
+  page = readticks();
+  after = uptime();
+  if (page < before || page > after)
+    printf(1, "uptimebench: time page %d, uptime %d\n", page, after);
+
+  printf(1, "uptime, 1 process: %d reads per tick\n", run(sysuptime, 1));
+  printf(1, "uptime, %d processes: %d reads per tick\n",
+         NPROCS, run(sysuptime, NPROCS));
+  printf(1, "time page, 1 process: %d reads per tick\n", run(pageuptime, 1));
+  printf(1, "time page, %d processes: %d reads per tick\n",
+         NPROCS, run(pageuptime, NPROCS));
+  exit();
+}
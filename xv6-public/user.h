@@ -1,8 +1,30 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct thread_attr;
+struct rusage;
+struct traceevent;
+struct mlfqparam;
 
 typedef int thread_t;
 
+// Futex based locks, see ulib.c.
+typedef struct {
+  volatile int state;   // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+  volatile int seq;     // bumped by every signal
+} cond_t;
+
+typedef struct {
+  mutex_t lock;
+  cond_t cond;
+  int n;                // threads to wait for
+  int count;            // threads arrived in this phase
+  int phase;
+} barrier_t;
+
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
@@ -12,6 +34,14 @@ int write(int, const void*, int);
 int read(int, void*, int);
 int pwrite(int, const void*, int, int);
 int pread(int, void*, int, int);
+int splice(int, int, int);
+int fcntl(int, int, int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int preadv(int, const struct iovec*, int, int);
+int pwritev(int, const struct iovec*, int, int);
 int close(int);
 int kill(int);
 int exec(char*, char**);
@@ -27,12 +57,24 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int freemem(void);
 int yield(void);
 int getlev(void);
 int set_cpu_share(int);
+int set_thread_share(thread_t, int);
+int getrusage(struct rusage*);
+int gettrace(struct traceevent*, int);
+int getmlfqparam(struct mlfqparam*);
+int setmlfqparam(struct mlfqparam*);
+int sched_deadline(int, int);
+int sched_setaffinity(int, uint);
 int thread_create(thread_t*, void*(*)(void*), void*);
 int thread_exit(void*);
 int thread_join(thread_t, void**);
+int thread_create_attr(thread_t*, const struct thread_attr*, void*(*)(void*), void*);
+int thread_yield(thread_t);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -47,3 +89,15 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint readticks(void);
+void* tls_self(void);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+int mutex_trylock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
+void barrier_init(barrier_t*, int);
+int barrier_wait(barrier_t*);
@@ -0,0 +1,208 @@
+//
+// User stacks of threads.
+// Stacks are placed in [STACKBASE, STACKTOP), away from the heap,
+// so sbrk never runs into them. The stack of a joined thread stays
+// mapped and is handed to the next thread asking for the same size;
+// cached stacks are unmapped when the region runs out or more than
+// NUSTACK of them pile up. Callers hold ptable.lock, except exec:
+// its ustackclear runs after killothers, when the calling thread is
+// the only one left, and only threads of the process itself walk
+// its stacks.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slab.h"
+
+static struct slab ustackslab;
+
+void
+ustackinit(void)
+{
+  slabinit(&ustackslab, "ustack", sizeof(struct ustack));
+}
+
+// Find highest free range of size bytes in the stack region.
+// Stacks are kept in descending address order, so the first
+// gap large enough is the one. Return the link to insert the
+// new stack at and write its base, or return 0 if there is no room.
+static struct ustack**
+ustackplace(struct proc *p, uint size, uint *base)
+{
+  struct ustack **ps;
+  uint top;
+
+  top = STACKTOP;
+  for(ps = &p->ustacks; *ps; ps = &(*ps)->next){
+    if(top - ((*ps)->base + (*ps)->size) >= size)
+      break;
+    top = (*ps)->base;
+  }
+  if(top < STACKBASE + size)
+    return 0;
+  *base = top - size;
+  return ps;
+}
+
+// Unmap cached stacks of p until at most keep are left.
+// Other cpus may still reach the pages through their TLBs and
+// the caller holds ptable.lock, so the pages go to p->stale for
+// proc.c to free after a TLB shootdown, see reapstacks.
+// Return number of unmapped stacks.
+static int
+ustackevict(struct proc *p, int keep)
+{
+  struct ustack **ps, *s;
+  int n, cached;
+  uint a;
+  char *mem;
+
+  cached = 0;
+  for(s = p->ustacks; s; s = s->next)
+    if(s->owner == 0)
+      cached++;
+
+  n = 0;
+  for(ps = &p->ustacks; *ps && cached > keep; ){
+    s = *ps;
+    if(s->owner){
+      ps = &s->next;
+      continue;
+    }
+    for(a = s->base; a < s->base + s->size; a += PGSIZE){
+      if((mem = unmapuvm(p->pgdir, a, 0)) == 0)
+        continue;
+      *(char**)mem = p->stale;
+      p->stale = mem;
+    }
+    *ps = s->next;
+    slabfree(&ustackslab, s);
+    cached--;
+    n++;
+  }
+  return n;
+}
+
+// Map a stack of size bytes with guard bytes of guard pages
+// below it for thread t of p, reusing a cached one if the sizes
+// match. Return top of the stack, or 0 on failure.
+uint
+ustackalloc(struct proc *p, struct thread *t, uint size, uint guard)
+{
+  struct ustack *s, **ps;
+  uint base, a;
+  int evicted;
+
+  for(s = p->ustacks; s; s = s->next){
+    if(s->owner == 0 && s->size == size && s->guard == guard){
+      s->owner = t;
+      t->ustack = s;
+      return s->base + s->size;
+    }
+  }
+
+  if((s = slaballoc(&ustackslab)) == 0)
+    return 0;
+  evicted = 0;
+retry:
+  if((ps = ustackplace(p, size, &base)) == 0 ||
+     allocuvm(p->pgdir, base, base + size) == 0){
+    // Make room from cached stacks once.
+    if(!evicted && ustackevict(p, 0) > 0){
+      evicted = 1;
+      goto retry;
+    }
+    slabfree(&ustackslab, s);
+    return 0;
+  }
+
+  // Guard pages fault instead of overflowing into the stack below.
+  for(a = base; a < base + guard; a += PGSIZE)
+    clearpteu(p->pgdir, (char*)a);
+
+  s->base = base;
+  s->size = size;
+  s->guard = guard;
+  s->owner = t;
+  s->next = *ps;
+  *ps = s;
+  t->ustack = s;
+  return base + size;
+}
+
+// Cache the stack of thread t for reuse.
+void
+ustackfree(struct proc *p, struct thread *t)
+{
+  if(t->ustack == 0)
+    return;
+  t->ustack->owner = 0;
+  t->ustack = 0;
+  ustackevict(p, NUSTACK);
+}
+
+// Return end of the accessible stack containing addr,
+// or 0 if addr is not in a stack of p.
+uint
+ustackend(struct proc *p, uint addr)
+{
+  struct ustack *s;
+  struct thread *t;
+
+  // Mostly the caller's own stack.
+  t = mythread();
+  if(t && (s = t->ustack) && s->base + s->guard <= addr &&
+     addr < s->base + s->size)
+    return s->base + s->size;
+
+  for(s = p->ustacks; s; s = s->next)
+    if(s->base + s->guard <= addr && addr < s->base + s->size)
+      return s->base + s->size;
+  return 0;
+}
+
+// Copy stacks of p into np. The stack of thread t becomes
+// the one of nt, the others are cached.
+int
+ustackdup(struct proc *np, struct proc *p, struct thread *t, struct thread *nt)
+{
+  struct ustack *s, *ns, **pns;
+
+  pns = &np->ustacks;
+  for(s = p->ustacks; s; s = s->next){
+    if((ns = slaballoc(&ustackslab)) == 0)
+      return -1;
+    *ns = *s;
+    ns->next = 0;
+    ns->owner = 0;
+    *pns = ns;
+    pns = &ns->next;
+    if(copyuvmrange(np->pgdir, p->pgdir, s->base, s->base + s->size) < 0)
+      return -1;
+    if(s->owner == t){
+      ns->owner = nt;
+      nt->ustack = ns;
+    }
+  }
+  return 0;
+}
+
+// Forget all stacks, their memory goes with the page table.
+void
+ustackclear(struct proc *p)
+{
+  struct ustack *s;
+
+  while((s = p->ustacks) != 0){
+    p->ustacks = s->next;
+    if(s->owner)
+      s->owner->ustack = 0;
+    slabfree(&ustackslab, s);
+  }
+}
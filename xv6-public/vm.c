@@ -6,10 +6,18 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "timepage.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+// Page of its own, as all of it is visible to user space.
+static union {
+  struct timepage tp;
+  char page[PGSIZE];
+} timepg __attribute__((aligned(PGSIZE)));
+struct timepage *timepage = &timepg.tp;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -132,6 +140,10 @@ setupkvm(void)
       freevm(pgdir);
       return 0;
     }
+  if(mappages(pgdir, (void*)TIMEPAGE, PGSIZE, V2P(&timepg), PTE_U) < 0){
+    freevm(pgdir);
+    return 0;
+  }
   return pgdir;
 }
 
@@ -152,20 +164,32 @@ switchkvm(void)
   lcr3(V2P(kpgdir));   // switch to the kernel page table
 }
 
-// Switch TSS and h/w page table to correspond to process p.
+// Install TLS segment of thread t, reloaded into %gs by trapret.
+// Threads without TLS get an empty segment.
+static void
+settls(struct thread *t)
+{
+  if(t->tlssize)
+    mycpu()->gdt[SEG_UTLS] = SEG16(STA_W, t->tls, t->tlssize-1, DPL_USER);
+  else
+    mycpu()->gdt[SEG_UTLS] = SEG16(STA_W, 0, 0, DPL_USER);
+}
+
+// Switch TSS and h/w page table to correspond to process p
+// and the thread running on this cpu.
 void
 switchuvm(struct proc *p)
 {
   struct thread *t;
   if(p == 0)
     panic("switchuvm: no process");
-  t = &p->threads[p->tidx];
-  if(t->kstack == 0)
-    panic("switchuvm: no kstack");
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
 
   pushcli();
+  t = mycpu()->thread;
+  if(t == 0 || t->kstack == 0)
+    panic("switchuvm: no kstack");
   mycpu()->gdt[SEG_TSS] = SEG16(STS_T32A, &mycpu()->ts,
                                 sizeof(mycpu()->ts)-1, 0);
   mycpu()->gdt[SEG_TSS].s = 0;
@@ -175,6 +199,7 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  settls(t);
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
@@ -187,13 +212,14 @@ switch_trap_kstack(struct proc *p)
   struct thread *t;
   if(p == 0)
     panic("switchuvm: no process");
-  t = &p->threads[p->tidx];
-  if(t->kstack == 0)
-    panic("switchuvm: no kstack");
 
   pushcli();
+  t = mycpu()->thread;
+  if(t == 0 || t->kstack == 0)
+    panic("switchuvm: no kstack");
   // switch default kernel stack to current thread.
   mycpu()->ts.esp0 = (uint)t->kstack + KSTACKSIZE;
+  settls(t);
   popcli();
 }
 
@@ -304,9 +330,13 @@ void
 freevm(pde_t *pgdir)
 {
   uint i;
+  pte_t *pte;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  // The time page is shared, not ours to free.
+  if((pte = walkpgdir(pgdir, (void*)TIMEPAGE, 0)) != 0)
+    *pte = 0;
   deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
@@ -364,6 +394,99 @@ bad:
   return 0;
 }
 
+// Map a single page mem at user address va.
+// Return -1 if page table pages cannot be allocated.
+int
+mapuvm(pde_t *pgdir, uint va, char *mem, int perm)
+{
+  return mappages(pgdir, (char*)va, PGSIZE, V2P(mem), perm);
+}
+
+// Make the user page at va absent but keep its frame and
+// dirty bit in the PTE for unmapuvm, so that the frame can be
+// freed once no TLB holds it.
+void
+hideuvm(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte)
+    *pte &= ~PTE_P;
+}
+
+// Remove the user page at va from pgdir without freeing it,
+// hidden by hideuvm or not. Return its kernel address, or 0
+// if nothing is mapped, and whether the page was written
+// since it was mapped.
+char*
+unmapuvm(pde_t *pgdir, uint va, int *dirty)
+{
+  pte_t *pte;
+  char *mem;
+
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || PTE_ADDR(*pte) == 0)
+    return 0;
+  mem = P2V(PTE_ADDR(*pte));
+  if(dirty)
+    *dirty = (*pte & PTE_D) != 0;
+  *pte = 0;
+  return mem;
+}
+
+// Copy the pages present in [start, end) of src into dst,
+// keeping their permissions. Absent pages stay absent.
+int
+copyuvmrange(pde_t *dst, pde_t *src, uint start, uint end)
+{
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(a = PGROUNDDOWN(start); a < end; a += PGSIZE){
+    if((pte = walkpgdir(src, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((*pte & PTE_P) == 0)
+      continue;
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+    if(mappages(dst, (char*)a, PGSIZE, V2P(mem), PTE_FLAGS(*pte)) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Map the pages present in [start, end) of src into dst too,
+// keeping their permissions. Absent pages stay absent.
+int
+shareuvmrange(pde_t *dst, pde_t *src, uint start, uint end)
+{
+  pte_t *pte;
+  uint a;
+  char *mem;
+
+  for(a = PGROUNDDOWN(start); a < end; a += PGSIZE){
+    if((pte = walkpgdir(src, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((*pte & PTE_P) == 0)
+      continue;
+    mem = P2V(PTE_ADDR(*pte));
+    // dst has not written the page yet.
+    if(mappages(dst, (char*)a, PGSIZE, V2P(mem), PTE_FLAGS(*pte) & ~PTE_D) < 0)
+      return -1;
+    kdup(mem);
+  }
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -372,7 +495,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
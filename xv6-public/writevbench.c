@@ -0,0 +1,149 @@
+/**
+ *  This program measures writing records composed of a header and
+ * a payload segment, with one write per segment compared to
+ * vectored writes of one or more records per call.
+ */
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "uio.h"
+
+#define FILENAME    "writevbench.dat"
+#define NRECORD     200     // records per file
+#define PAYLOAD     240     // (bytes) payload per record
+#define BATCH       8       // records per call in batched mode
+#define NROUND      10      // default number of files written
+
+struct header {
+  int seq;
+  int len;
+  int sum;
+  int magic;
+};
+
+struct header headers[NRECORD];
+char payload[PAYLOAD];
+
+enum mode { WRITE, WRITEV, WRITEV_BATCH, PWRITE, PWRITEV, NMODE };
+
+char *modename[NMODE] = {
+  "write x2",
+  "writev",
+  "writev batch",
+  "pwrite x2",
+  "pwritev",
+};
+
+// Write all records to fd with given mode.
+int
+writerecords(int fd, int mode)
+{
+  int i, j, n, off;
+  struct iovec iov[2 * BATCH];
+
+  for (i = 0; i < NRECORD; i += n) {
+    n = 1;
+    off = i * (sizeof(struct header) + PAYLOAD);
+    switch (mode) {
+    case WRITE:
+      if (write(fd, &headers[i], sizeof(struct header)) < 0 ||
+          write(fd, payload, PAYLOAD) < 0)
+        return -1;
+      break;
+    case PWRITE:
+      if (pwrite(fd, &headers[i], sizeof(struct header), off) < 0 ||
+          pwrite(fd, payload, PAYLOAD, off + sizeof(struct header)) < 0)
+        return -1;
+      break;
+    case WRITEV:
+    case PWRITEV:
+    case WRITEV_BATCH:
+      if (mode == WRITEV_BATCH)
+        n = NRECORD - i < BATCH ? NRECORD - i : BATCH;
+      for (j = 0; j < n; ++j) {
+        iov[2 * j].iov_base = &headers[i + j];
+        iov[2 * j].iov_len = sizeof(struct header);
+        iov[2 * j + 1].iov_base = payload;
+        iov[2 * j + 1].iov_len = PAYLOAD;
+      }
+      if (mode == PWRITEV) {
+        if (pwritev(fd, iov, 2 * n, off) < 0)
+          return -1;
+      } else if (writev(fd, iov, 2 * n) < 0)
+        return -1;
+      break;
+    }
+  }
+  return 0;
+}
+
+// Read records back with readv and check their headers.
+int
+checkrecords(void)
+{
+  int i, fd;
+  struct header h;
+  char buf[PAYLOAD];
+  struct iovec iov[2];
+
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    return -1;
+
+  iov[0].iov_base = &h;
+  iov[0].iov_len = sizeof(h);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = PAYLOAD;
+  for (i = 0; i < NRECORD; ++i) {
+    if (readv(fd, iov, 2) != sizeof(h) + PAYLOAD ||
+        h.seq != i || h.magic != headers[i].magic ||
+        buf[PAYLOAD - 1] != payload[PAYLOAD - 1]) {
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, mode, fd, start, ticks;
+  int nround = NROUND;
+
+  if (argc >= 2)
+    nround = atoi(argv[1]);
+
+  for (i = 0; i < PAYLOAD; ++i)
+    payload[i] = i;
+  for (i = 0; i < NRECORD; ++i) {
+    headers[i].seq = i;
+    headers[i].len = PAYLOAD;
+    headers[i].sum = i * PAYLOAD;
+    headers[i].magic = 0x5245;
+  }
+
+  for (mode = 0; mode < NMODE; ++mode) {
+    start = uptime();
+    for (i = 0; i < nround; ++i) {
+      if ((fd = open(FILENAME, O_CREATE|O_RDWR)) < 0 ||
+          writerecords(fd, mode) < 0) {
+        printf(1, "writevbench: %s failed\n", modename[mode]);
+        exit();
+      }
+      close(fd);
+    }
+    ticks = uptime() - start;
+
+    if (checkrecords() < 0) {
+      printf(1, "writevbench: %s wrote wrong records\n", modename[mode]);
+      exit();
+    }
+    printf(1, "%s: %d records in %d ticks\n",
+           modename[mode], nround * NRECORD, ticks);
+    unlink(FILENAME);
+  }
+  exit();
+}
@@ -117,6 +117,36 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until one arrives. An interrupt
+// cannot come in between, as sti takes effect after hlt.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
+// Read the time-stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 tsc;
+  asm volatile("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+// Divide n by d without libgcc.
+static inline uint64
+udiv64(uint64 n, uint d)
+{
+  uint hi, lo, r;
+
+  hi = n >> 32;
+  r = hi % d;
+  hi /= d;
+  asm("divl %4" : "=a" (lo), "=d" (r) : "a" ((uint)n), "d" (r), "rm" (d));
+  return ((uint64)hi << 32) | lo;
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -144,6 +174,14 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().